@@ -0,0 +1,21 @@
+#include "audio.h"
+
+SquareWave::SquareWave()
+	: on(false)
+	, phase(0)
+	, step((uint32_t)(((uint64_t)FREQUENCY << 32) / SAMPLE_RATE))
+{
+}
+
+void SquareWave::generate(int16_t* out, size_t n){
+	if (!is_on()){
+		phase = 0;
+		for (size_t i = 0; i < n; i++)
+			out[i] = 0;
+		return;
+	}
+	for (size_t i = 0; i < n; i++){
+		out[i] = (phase < 0x80000000u ? AMPLITUDE : -AMPLITUDE);
+		phase += step;
+	}
+}
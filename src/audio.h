@@ -0,0 +1,45 @@
+#ifndef _AUDIO_H
+#define _AUDIO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+// Square wave generator for the CHIP-8 buzzer. The emulation thread turns it
+// on and off with set_on() once per frame, and the audio thread pulls
+// samples from it with generate(). The flag is the only state they share,
+// so the tone starts and stops with at most one audio buffer of latency.
+class SquareWave {
+	public:
+		static const int     SAMPLE_RATE = 44100;
+		static const int     FREQUENCY   = 440;
+		static const int16_t AMPLITUDE   = 3000;
+
+		// Samples played in one frame at 60 FPS
+		static const int SAMPLES_PER_FRAME = SAMPLE_RATE / 60;
+
+		SquareWave();
+
+		// Play the tone or silence. Called from the emulation thread
+		void set_on(bool on){
+			this->on.store(on, std::memory_order_relaxed);
+		}
+
+		bool is_on() const {
+			return on.load(std::memory_order_relaxed);
+		}
+
+		// Write `n` samples into `out`. Called from the audio thread
+		void generate(int16_t* out, size_t n);
+
+	private:
+		std::atomic<bool> on;
+
+		// Position in the period, as a fraction of 2^32. The tone is high
+		// during the first half. It only advances while the tone plays, so
+		// each tone starts at the beginning of a period
+		uint32_t phase;
+		uint32_t step;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "emulator.h"
+#include "movie.h"
+#include "capture.h"
+#include "rom_cache.h"
+#include "thread_pool.h"
+
+// Runs many emulator instances headless across all cores, each one for a
+// fixed number of frames, and writes a JSON report with the results.
+
+struct Job {
+	const char* rom;
+	uint32_t    seed;
+	const char* input;      // "none", "script" or "movie"
+	const Movie* movie;     // Keys of every frame
+	std::string capture;    // GIF of the screen, if captured
+
+	// Results
+	uint64_t    frames;
+	uint64_t    instructions;
+	uint64_t    screen_hash;
+	std::string fault;
+	double      time;
+};
+
+void usage(const char* prog){
+	fprintf(stderr, "Usage: %s [-j threads] [-f frames] [-i instructions-per-frame] "
+	                "[-b switch|threaded|jit] [-s seed] [-n instances-per-rom] "
+	                "[-k keys-script] [-p] [-c capture-dir] [-o report.json] "
+	                "romfile...\n", prog);
+	fprintf(stderr,
+		"  -k  press keys following a script. Each line is `frame keys`, with\n"
+		"      keys being a hex mask of the keys pressed from that frame on\n"
+		"  -p  replay <romfile>.movie instead if it exists, with its seed and\n"
+		"      instructions per frame\n"
+		"  -c  capture the screen of each instance into capture-dir, as an\n"
+		"      animated GIF named <index>-<rom>.gif\n");
+	exit(EXIT_FAILURE);
+}
+
+// Load a keys script into `movie`, which will have `frames` frames
+bool load_script(const char* filename, size_t frames, Movie& movie){
+	FILE* f = fopen(filename, "r");
+	if (!f)
+		return false;
+
+	std::vector<uint16_t> keys(frames, 0);
+	char line[256];
+	int line_num = 0;
+	while (fgets(line, sizeof(line), f)){
+		line_num++;
+		char* p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+		unsigned long frame, mask;
+		if (sscanf(p, "%lu %lx", &frame, &mask) != 2 || mask > 0xFFFF){
+			fprintf(stderr, "%s:%d: invalid line\n", filename, line_num);
+			fclose(f);
+			errno = EINVAL;
+			return false;
+		}
+		for (size_t i = frame; i < frames; i++)
+			keys[i] = mask;
+	}
+	fclose(f);
+
+	for (uint16_t k : keys)
+		movie.push(k);
+	return true;
+}
+
+// Write `s` as a JSON string
+void json_string(FILE* f, const char* s){
+	fputc('"', f);
+	for (; *s; s++){
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+void run_job(Job& job, Emulator::Backend backend, uint inst_per_frame,
+             RomCache& cache){
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+
+	ReplayFrontend frontend(*job.movie);
+	Emulator emu(job.rom, frontend, &cache);
+	emu.set_backend(backend);
+	emu.set_seed(job.seed);
+
+	std::unique_ptr<Capture> capture;
+	if (!job.capture.empty())
+		capture.reset(new Capture(job.capture.c_str(), Capture::FORMAT_GIF));
+
+	job.frames       = 0;
+	job.instructions = 0;
+	while (job.frames < job.movie->size() && emu.is_running()){
+		job.instructions += emu.run_frame(inst_per_frame);
+		job.frames++;
+		if (capture)
+			capture->frame(emu.get_framebuf());
+	}
+	if (capture && !capture->close())
+		fprintf(stderr, "Error capturing: %s\n", capture->get_error().c_str());
+	job.screen_hash = emu.screen_hash();
+	job.fault       = emu.get_fault();
+	job.time = std::chrono::duration<double>(clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+	// Parse options
+	uint threads = 0;
+	size_t frames = 600;
+	uint inst_per_frame = Emulator::DEFAULT_INST_PER_FRAME;
+	const char* backend_name = "switch";
+	Emulator::Backend backend = Emulator::BACKEND_SWITCH;
+	uint32_t seed = 0;
+	uint instances = 1;
+	const char* script_path = NULL;
+	bool use_movies = false;
+	const char* report_path = NULL;
+	const char* capture_dir = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:f:i:b:s:n:k:pc:o:")) != -1){
+		switch (opt){
+			case 'j': threads = atoi(optarg); break;
+			case 'f': frames = atol(optarg); break;
+			case 'i': inst_per_frame = atoi(optarg); break;
+			case 's': seed = strtoul(optarg, NULL, 0); break;
+			case 'n': instances = atoi(optarg); break;
+			case 'k': script_path = optarg; break;
+			case 'p': use_movies = true; break;
+			case 'c': capture_dir = optarg; break;
+			case 'o': report_path = optarg; break;
+			case 'b':
+				backend_name = optarg;
+				if (!Emulator::parse_backend(optarg, backend))
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind == argc || instances == 0)
+		usage(argv[0]);
+
+	// Input of the instances that don't replay a movie
+	Movie script;
+	const char* script_input = "none";
+	if (script_path){
+		if (!load_script(script_path, frames, script)){
+			perror(script_path);
+			return EXIT_FAILURE;
+		}
+		script_input = "script";
+	} else {
+		for (size_t i = 0; i < frames; i++)
+			script.push(0);
+	}
+
+	// Create the jobs. Movies are loaded before running, so jobs only
+	// read shared data
+	std::vector<Movie> movies(argc - optind);
+	std::vector<Job> jobs;
+	for (int i = optind; i < argc; i++){
+		Movie& movie = movies[i - optind];
+		bool has_movie = use_movies &&
+		                 movie.load((std::string(argv[i]) + ".movie").c_str());
+		for (uint n = 0; n < instances; n++){
+			Job job;
+			job.rom   = argv[i];
+			job.seed  = (has_movie ? movie.seed : seed + n);
+			job.input = (has_movie ? "movie" : script_input);
+			job.movie = (has_movie ? &movie : &script);
+			if (capture_dir){
+				std::string rom = argv[i];
+				job.capture = std::string(capture_dir) + "/" +
+				              std::to_string(jobs.size()) + "-" +
+				              basename(&rom[0]) + ".gif";
+			}
+			jobs.push_back(job);
+
+			// Instances of the same movie would all be the same
+			if (has_movie)
+				break;
+		}
+	}
+
+	// Run them. Instances of the same ROM share it through the cache
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	RomCache cache;
+	ThreadPool pool(threads);
+	pool.run(jobs.size(), [&](size_t i, uint thread){
+		Job& job = jobs[i];
+		uint ipf = (job.movie == &script ? inst_per_frame
+		                                 : job.movie->inst_per_frame);
+		run_job(job, backend, ipf, cache);
+	});
+	double time = std::chrono::duration<double>(clock::now() - start).count();
+
+	// Write the report
+	FILE* f = stdout;
+	if (report_path && !(f = fopen(report_path, "w"))){
+		perror(report_path);
+		return EXIT_FAILURE;
+	}
+	uint64_t total_inst = 0;
+	size_t faults = 0;
+	fprintf(f, "{\n");
+	fprintf(f, "  \"backend\": \"%s\",\n", backend_name);
+	fprintf(f, "  \"threads\": %u,\n", pool.size());
+	fprintf(f, "  \"frames\": %zu,\n", frames);
+	fprintf(f, "  \"inst_per_frame\": %u,\n", inst_per_frame);
+	fprintf(f, "  \"results\": [\n");
+	for (size_t i = 0; i < jobs.size(); i++){
+		const Job& job = jobs[i];
+		fprintf(f, "    {\"rom\": ");
+		json_string(f, job.rom);
+		fprintf(f, ", \"seed\": %u, \"input\": \"%s\", \"frames\": %lu, "
+		           "\"instructions\": %lu, \"screen_hash\": \"%016lx\", "
+		           "\"fault\": ", job.seed, job.input, job.frames,
+		           job.instructions, job.screen_hash);
+		if (job.fault.empty())
+			fprintf(f, "null");
+		else
+			json_string(f, job.fault.c_str());
+		if (!job.capture.empty()){
+			fprintf(f, ", \"capture\": ");
+			json_string(f, job.capture.c_str());
+		}
+		fprintf(f, ", \"time\": %.6f}%s\n", job.time,
+		        (i == jobs.size()-1 ? "" : ","));
+		total_inst += job.instructions;
+		faults += !job.fault.empty();
+	}
+	fprintf(f, "  ],\n");
+	fprintf(f, "  \"instances\": %zu,\n", jobs.size());
+	fprintf(f, "  \"faults\": %zu,\n", faults);
+	fprintf(f, "  \"instructions\": %lu,\n", total_inst);
+	fprintf(f, "  \"time\": %.6f\n", time);
+	fprintf(f, "}\n");
+	if (f != stdout)
+		fclose(f);
+
+	fprintf(stderr, "%zu instances, %zu faults, %.1f MIPS in %.2fs\n",
+	        jobs.size(), faults, total_inst/time/1e6, time);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "emulator.h"
+#include "frontend_null.h"
+#include "sprite.h"
+
+// Runs ROMs headless with deterministic input and reports how fast they are
+// emulated. Everything but the timings is deterministic, so the output of
+// two builds can be diffed to catch both performance and behaviour changes.
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+	Emulator::Stats stats;
+	uint64_t    screen_hash;
+	std::string fault;
+	double      time; // Best of all repetitions, in seconds
+};
+
+void usage(const char* prog){
+	fprintf(stderr, "Usage: %s [-b switch|threaded|jit] [-n instructions] "
+	                "[-i instructions-per-frame] [-r repetitions] "
+	                "[rom-dir | romfile...]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+// Keys pressed at `frame`: a different key every 12 frames, pressed during 6
+// of them, so ROMs waiting for a key make progress
+uint16_t bench_keys(uint64_t frame){
+	if (frame % 12 >= 6)
+		return 0;
+	return 1 << ((frame / 12) * 7 % 16);
+}
+
+bool is_dir(const char* path){
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// List the files in `dir`, sorted
+std::vector<std::string> list_roms(const char* dir){
+	std::vector<std::string> roms;
+	DIR* d = opendir(dir);
+	if (!d){
+		perror(dir);
+		exit(EXIT_FAILURE);
+	}
+	while (struct dirent* entry = readdir(d)){
+		if (entry->d_name[0] != '.')
+			roms.push_back(std::string(dir) + "/" + entry->d_name);
+	}
+	closedir(d);
+	std::sort(roms.begin(), roms.end());
+	return roms;
+}
+
+// Run `rom` until it has run `instructions` instructions, it stops or it
+// gets stuck
+void run_rom(const char* rom, Emulator::Backend backend, uint64_t instructions,
+             uint inst_per_frame, Result& result){
+	NullFrontend frontend;
+	Emulator emu(rom, frontend);
+	emu.set_backend(backend);
+	emu.set_seed(0);
+
+	Clock::time_point start = Clock::now();
+	uint64_t frame = 0;
+	while (emu.get_stats().instructions < instructions && emu.is_running() &&
+	       frame < instructions){
+		frontend.set_keys(bench_keys(frame++));
+		emu.run_frame(inst_per_frame);
+	}
+	double time = std::chrono::duration<double>(Clock::now() - start).count();
+
+	result.stats       = emu.get_stats();
+	result.screen_hash = emu.screen_hash();
+	result.fault       = emu.get_fault();
+	result.time        = std::min(result.time, time);
+}
+
+// Percentage `part` is of `whole`, or 0 if `whole` is 0
+double percent(uint64_t part, uint64_t whole){
+	return whole ? 100.0 * part / whole : 0;
+}
+
+// Nanoseconds taken by draw_sprite() to draw a sprite of `rows` rows. The
+// result is cached, since it only depends on the size
+double sprite_cost(int rows){
+	static double cost[16] = {0};
+	if (rows < 1 || rows > 15)
+		return 0;
+	if (cost[rows])
+		return cost[rows];
+
+	uint64_t framebuf[FRAMEBUF_H] = {0};
+	uint8_t sprite[15];
+	for (int i = 0; i < 15; i++)
+		sprite[i] = 0x3C ^ (i * 0x5B);
+
+	// Draw at positions that include wrapping around both edges. Collisions
+	// are accumulated so the calls can't be optimized away
+	const int CALLS = 1 << 20;
+	volatile int collisions = 0;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < CALLS; i++)
+		collisions += draw_sprite(framebuf, sprite, rows, i*37, i*11);
+	double time = std::chrono::duration<double>(Clock::now() - start).count();
+	cost[rows] = time / CALLS * 1e9;
+	return cost[rows];
+}
+
+int main(int argc, char** argv){
+	// Parse options
+	const char* backend_name = "switch";
+	Emulator::Backend backend = Emulator::BACKEND_SWITCH;
+	uint64_t instructions = 5000000;
+	uint inst_per_frame = Emulator::DEFAULT_INST_PER_FRAME;
+	int repetitions = 3;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:n:i:r:")) != -1){
+		switch (opt){
+			case 'n': instructions = strtoull(optarg, NULL, 0); break;
+			case 'i': inst_per_frame = atoi(optarg); break;
+			case 'r': repetitions = atoi(optarg); break;
+			case 'b':
+				backend_name = optarg;
+				if (!Emulator::parse_backend(optarg, backend))
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (inst_per_frame == 0 || repetitions < 1)
+		usage(argv[0]);
+
+	std::vector<std::string> roms;
+	if (optind == argc)
+		roms = list_roms("roms");
+	else if (argc - optind == 1 && is_dir(argv[optind]))
+		roms = list_roms(argv[optind]);
+	else
+		roms.assign(argv + optind, argv + argc);
+
+	printf("backend %s, %lu instructions, %u instructions per frame, best of %d\n\n",
+	       backend_name, instructions, inst_per_frame, repetitions);
+	printf("%-12s %12s %9s %9s %-16s %8s %10s %8s %8s %8s %8s\n", "rom",
+	       "instructions", "frames", "sprites", "screen-hash", "MIPS",
+	       "frames/s", "ns/Dxyn", "sprite%", "other%", "elided%");
+
+	uint64_t total_inst = 0, total_frames = 0, total_elided = 0;
+	double total_time = 0, total_sprite_time = 0;
+	for (const std::string& rom : roms){
+		Result result;
+		result.time = 1e30;
+		for (int i = 0; i < repetitions; i++)
+			run_rom(rom.c_str(), backend, instructions, inst_per_frame, result);
+
+		// Time spent drawing sprites, estimated from the cost of drawing
+		// sprites of the average size of the ROM ones
+		const Emulator::Stats& stats = result.stats;
+		double ns_per_sprite = 0;
+		if (stats.sprites){
+			int rows = (stats.sprite_rows + stats.sprites/2) / stats.sprites;
+			ns_per_sprite = sprite_cost(rows);
+		}
+		double sprite_time = stats.sprites * ns_per_sprite / 1e9;
+		double sprite_pct  = std::min(100.0, 100 * sprite_time / result.time);
+
+		std::string name = basename((char*)rom.c_str());
+		printf("%-12s %12lu %9lu %9lu %016lx %8.1f %10.0f %8.1f %8.1f %8.1f %8.1f",
+		       name.c_str(), stats.instructions, stats.frames, stats.sprites,
+		       result.screen_hash, stats.instructions / result.time / 1e6,
+		       stats.frames / result.time, ns_per_sprite, sprite_pct,
+		       100 - sprite_pct, percent(stats.elided, stats.instructions));
+		if (!result.fault.empty())
+			printf("  fault: %s", result.fault.c_str());
+		printf("\n");
+
+		total_inst        += stats.instructions;
+		total_frames      += stats.frames;
+		total_elided      += stats.elided;
+		total_time        += result.time;
+		total_sprite_time += sprite_time;
+	}
+
+	// Without ROMs there's no time to divide by
+	if (roms.empty())
+		return EXIT_SUCCESS;
+
+	double sprite_pct = 100 * total_sprite_time / total_time;
+	printf("%-12s %12lu %9lu %9s %-16s %8.1f %10.0f %8s %8.1f %8.1f %8.1f\n", "total",
+	       total_inst, total_frames, "", "", total_inst / total_time / 1e6,
+	       total_frames / total_time, "", sprite_pct, 100 - sprite_pct,
+	       percent(total_elided, total_inst));
+}
@@ -0,0 +1,329 @@
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <algorithm>
+#include <vector>
+#include "capture.h"
+#include "emulator.h"
+
+// Table for the CRC of PNG chunks
+struct CrcTable {
+	uint32_t table[256];
+
+	CrcTable(){
+		for (uint32_t n = 0; n < 256; n++){
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1);
+			table[n] = c;
+		}
+	}
+
+	uint32_t crc(uint32_t c, const uint8_t* data, size_t size) const {
+		for (size_t i = 0; i < size; i++)
+			c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+		return c;
+	}
+};
+static const CrcTable crc_table;
+
+static void put_be32(uint8_t* p, uint32_t value){
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+// Bytes of a framebuffer row, leftmost pixels first
+static void row_bytes(uint64_t row, uint8_t* bytes){
+	for (int i = 0; i < 8; i++)
+		bytes[i] = row >> (56 - i*8);
+}
+
+Capture::Format Capture::format_for(const char* path){
+	const char* ext = strrchr(path, '.');
+	if (ext && !strcasecmp(ext, ".png"))
+		return FORMAT_PNG;
+	if (ext && !strcasecmp(ext, ".gif"))
+		return FORMAT_GIF;
+	return FORMAT_RAW;
+}
+
+Capture::Capture(const char* path, Format format)
+	: path(path)
+	, format(format)
+	, n_frames(0)
+	, n_images(0)
+	, closing(false)
+	, file(NULL)
+	, written_frames(0)
+	, gif_time(0)
+{
+	writer = std::thread(&Capture::write_images, this);
+}
+
+Capture::~Capture(){
+	close();
+}
+
+void Capture::frame(const uint64_t* framebuf){
+	// Most frames are the same as the previous one
+	if (n_frames && current.duration < UINT32_MAX &&
+	    !memcmp(current.rows, framebuf, sizeof(current.rows))){
+		current.duration++;
+		n_frames++;
+		return;
+	}
+	if (n_frames)
+		push();
+	memcpy(current.rows, framebuf, sizeof(current.rows));
+	current.duration = 1;
+	n_frames++;
+}
+
+void Capture::push(){
+	std::unique_lock<std::mutex> guard(lock);
+	dequeued.wait(guard, [this]{ return queue.size() < MAX_QUEUED; });
+	queue.push_back(current);
+	n_images++;
+	if (queue.size() == 1)
+		queued.notify_one();
+}
+
+bool Capture::close(){
+	if (writer.joinable()){
+		if (n_frames)
+			push();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closing = true;
+			queued.notify_one();
+		}
+		writer.join();
+	}
+	return error.empty();
+}
+
+const std::string& Capture::get_error() const {
+	return error;
+}
+
+uint64_t Capture::frames() const {
+	return n_frames;
+}
+
+uint64_t Capture::images() const {
+	return n_images;
+}
+
+void Capture::write_images(){
+	if (format != FORMAT_PNG){
+		file = fopen(path.c_str(), "wb");
+		if (!file)
+			fail(path + ": " + strerror(errno));
+		else if (format == FORMAT_GIF)
+			write_gif_header();
+	}
+
+	// Take all the queued images at once
+	std::deque<Image> images;
+	while (true){
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			queued.wait(guard, [this]{ return !queue.empty() || closing; });
+			if (queue.empty())
+				break;
+			images.swap(queue);
+			dequeued.notify_one();
+		}
+		for (const Image& image : images)
+			write_image(image);
+		images.clear();
+	}
+
+	if (file){
+		if (format == FORMAT_GIF)
+			put(file, "\x3B", 1); // Trailer
+		if (fclose(file) != 0)
+			fail(path + ": " + strerror(errno));
+		file = NULL;
+	}
+}
+
+void Capture::write_image(const Image& image){
+	if (!error.empty())
+		return;
+
+	if (format == FORMAT_RAW){
+		uint8_t record[4 + 8*FRAMEBUF_H];
+		uint32_t duration = image.duration;
+		for (int i = 0; i < 4; i++)
+			record[i] = duration >> (i*8);
+		for (int y = 0; y < FRAMEBUF_H; y++)
+			row_bytes(image.rows[y], &record[4 + y*8]);
+		put(file, record, sizeof(record));
+
+	} else if (format == FORMAT_PNG){
+		// Named after the frame where the image appears
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), "-%06lu.png", written_frames);
+		std::string name = path.substr(0, path.size() - strlen(".png")) + suffix;
+		FILE* f = fopen(name.c_str(), "wb");
+		if (!f){
+			fail(name + ": " + strerror(errno));
+			return;
+		}
+		write_png(f, image.rows);
+		if (fclose(f) != 0)
+			fail(name + ": " + strerror(errno));
+
+	} else {
+		// Delay from the end of the image, rounded
+		uint64_t end   = ((written_frames + image.duration)*100 + Emulator::FPS/2)
+		                 / Emulator::FPS;
+		uint64_t delay = (end > gif_time + 2 ? end - gif_time : 2);
+		gif_time += delay;
+
+		// Images that last too long are repeated
+		for (; delay > 0xFFFF; delay -= 0xFFFF)
+			write_gif_image(image.rows, 0xFFFF);
+		write_gif_image(image.rows, delay);
+	}
+	written_frames += image.duration;
+}
+
+void Capture::write_png(FILE* f, const uint64_t* rows){
+	static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	// Each chunk has its size, type, data and the CRC of type and data
+	auto chunk = [&](const char* type, const uint8_t* data, uint32_t size){
+		uint8_t buf[8];
+		put_be32(buf, size);
+		memcpy(buf+4, type, 4);
+		uint32_t crc = crc_table.crc(0xFFFFFFFF, buf+4, 4);
+		crc = crc_table.crc(crc, data, size) ^ 0xFFFFFFFF;
+		put(f, buf, 8);
+		put(f, data, size);
+		put_be32(buf, crc);
+		put(f, buf, 4);
+	};
+
+	// 1-bit grayscale, so pixels are stored as they are in the framebuffer
+	uint8_t header[13] = { 0 };
+	put_be32(header, FRAMEBUF_W);
+	put_be32(header+4, FRAMEBUF_H);
+	header[8] = 1; // Bit depth
+
+	// Image data is a zlib stream. It's so small that it's stored in a
+	// single uncompressed block, so there's no need for a deflate library
+	const uint16_t ROW = 1 + FRAMEBUF_W/8; // Filter type and pixels
+	const uint16_t LEN = ROW*FRAMEBUF_H;
+	uint8_t data[2 + 5 + LEN + 4];
+	data[0] = 0x78; // zlib header, no compression
+	data[1] = 0x01;
+	data[2] = 0x01; // Last block, stored
+	data[3] = LEN & 0xFF;
+	data[4] = LEN >> 8;
+	data[5] = ~LEN & 0xFF;
+	data[6] = ~LEN >> 8;
+	uint8_t* raw = data + 7;
+	for (int y = 0; y < FRAMEBUF_H; y++){
+		raw[y*ROW] = 0; // No filter
+		row_bytes(rows[y], &raw[y*ROW + 1]);
+	}
+	uint32_t a = 1, b = 0;
+	for (int i = 0; i < LEN; i++){
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	put_be32(raw + LEN, (b << 16) | a);
+
+	put(f, SIGNATURE, sizeof(SIGNATURE));
+	chunk("IHDR", header, sizeof(header));
+	chunk("IDAT", data, sizeof(data));
+	chunk("IEND", NULL, 0);
+}
+
+void Capture::write_gif_header(){
+	static const uint8_t HEADER[] = {
+		'G', 'I', 'F', '8', '9', 'a',
+		FRAMEBUF_W, 0, FRAMEBUF_H, 0,
+		0x80, 0, 0,       // Global color table of 2 colors
+		0, 0, 0,          // Black
+		0xFF, 0xFF, 0xFF, // White
+		// Loop forever
+		0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+		3, 1, 0, 0, 0,
+	};
+	put(file, HEADER, sizeof(HEADER));
+}
+
+void Capture::write_gif_image(const uint64_t* rows, uint16_t delay){
+	uint8_t header[] = {
+		// Graphic control extension: don't dispose, delay
+		0x21, 0xF9, 4, 0x04, (uint8_t)delay, (uint8_t)(delay >> 8), 0, 0,
+		// Image descriptor: the whole screen
+		0x2C, 0, 0, 0, 0, FRAMEBUF_W, 0, FRAMEBUF_H, 0, 0,
+		2, // LZW minimum code size
+	};
+	put(file, header, sizeof(header));
+
+	// LZW with a trie of codes. Pixels are 0 or 1, but the minimum code
+	// size is 2, so the first codes are 4 to clear and 5 to end
+	const uint16_t CLEAR = 4, END = 5, FIRST = 6, MAX_CODES = 4096;
+	uint16_t next[MAX_CODES][2]; // 0 if there's no such code
+	std::vector<uint8_t> out;
+	uint32_t bits = 0, n_bits = 0, code_size = 3;
+	auto emit = [&](uint16_t code){
+		bits   |= code << n_bits;
+		n_bits += code_size;
+		for (; n_bits >= 8; n_bits -= 8, bits >>= 8)
+			out.push_back(bits);
+	};
+
+	memset(next, 0, sizeof(next));
+	uint16_t n_codes = FIRST;
+	emit(CLEAR);
+	uint16_t code = rows[0] >> 63;
+	for (int i = 1; i < FRAMEBUF_W*FRAMEBUF_H; i++){
+		uint8_t pixel = (rows[i / FRAMEBUF_W] >> (63 - i % FRAMEBUF_W)) & 1;
+		if (next[code][pixel]){
+			code = next[code][pixel];
+			continue;
+		}
+		emit(code);
+		if (n_codes < MAX_CODES){
+			if (n_codes == (1 << code_size))
+				code_size++;
+			next[code][pixel] = n_codes++;
+		} else {
+			emit(CLEAR);
+			memset(next, 0, sizeof(next));
+			n_codes   = FIRST;
+			code_size = 3;
+		}
+		code = pixel;
+	}
+	emit(code);
+	emit(END);
+	if (n_bits > 0)
+		out.push_back(bits);
+
+	// Data goes in sub-blocks of at most 255 bytes, ending with an empty one
+	for (size_t i = 0; i < out.size(); i += 255){
+		uint8_t size = std::min<size_t>(out.size() - i, 255);
+		put(file, &size, 1);
+		put(file, &out[i], size);
+	}
+	put(file, "", 1);
+}
+
+void Capture::put(FILE* f, const void* data, size_t size){
+	if (size && fwrite(data, size, 1, f) != 1)
+		fail(path + ": " + strerror(errno));
+}
+
+void Capture::fail(const std::string& msg){
+	if (error.empty())
+		error = msg;
+}
@@ -0,0 +1,112 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include "frontend.h"
+
+// Records the screen of a headless run. frame() is called once per emulated
+// frame, and consecutive identical frames are merged into a single image
+// that lasts for a number of frames. Images are encoded and written by a
+// background thread, so the emulation only compares and copies framebuffers.
+//
+// Formats:
+// - Raw: a stream of records, one per image. Each one has the duration in
+//   frames as a 32 bit little endian word, and the framebuffer: 32 rows of 8
+//   bytes, the most significant bit of the first byte being the leftmost
+//   pixel.
+// - PNG sequence: one 1-bit grayscale PNG per image. For path `dir/out.png`
+//   they are named `dir/out-<frame>.png`, with the number of the frame where
+//   the image appears, so each one lasts until the next one.
+// - GIF: a looping animated GIF, with the delay of each image rounded to
+//   hundredths of a second.
+class Capture {
+	public:
+		enum Format {
+			FORMAT_RAW,
+			FORMAT_PNG,
+			FORMAT_GIF,
+		};
+
+		// Format for the extension of `path`: ".png", ".gif" or raw for
+		// anything else
+		static Format format_for(const char* path);
+
+		// Start capturing into `path`. Errors opening or writing files are
+		// reported by close()
+		Capture(const char* path, Format format);
+
+		// Close it if it wasn't closed
+		~Capture();
+
+		// Add a frame with the screen `framebuf`
+		void frame(const uint64_t* framebuf);
+
+		// Write what's left and wait for the background thread to finish.
+		// Returns false if there was an error, see get_error()
+		bool close();
+
+		// Error writing the capture, empty if there's none
+		const std::string& get_error() const;
+
+		// Frames captured, and images they were merged into
+		uint64_t frames() const;
+		uint64_t images() const;
+
+	private:
+		struct Image {
+			uint64_t rows[FRAMEBUF_H];
+			uint32_t duration; // In frames
+		};
+
+		// Images waiting for the background thread. If there are too many,
+		// frame() waits for it to catch up
+		static const size_t MAX_QUEUED = 4096;
+
+		std::string path;
+		Format      format;
+
+		// Image being extended with identical frames. It's valid once a
+		// frame has been added
+		Image       current;
+		uint64_t    n_frames;
+		uint64_t    n_images;
+
+		std::mutex              lock;
+		std::condition_variable queued;   // Images queued or closing
+		std::condition_variable dequeued; // Space in the queue
+		std::deque<Image>       queue;
+		bool                    closing;
+		std::thread             writer;
+
+		// Only used by the background thread until it finishes
+		FILE*       file;
+		uint64_t    written_frames; // Frames of the images written
+		std::string error;
+
+		// Hundredths of a second of the GIF images written. Viewers slow
+		// down delays shorter than 2, so they are at least 2 and the next
+		// images are shortened to catch up
+		uint64_t    gif_time;
+
+		// Queue `current`
+		void push();
+
+		// Background thread. Write images until closing
+		void write_images();
+		void write_image(const Image& image);
+		void write_png(FILE* f, const uint64_t* rows);
+		void write_gif_header();
+		void write_gif_image(const uint64_t* rows, uint16_t delay);
+
+		// Write `size` bytes, keeping the first error
+		void put(FILE* f, const void* data, size_t size);
+		void fail(const std::string& msg);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include "cfg.h"
+#include "inst.h"
+
+// Jump tables of Bnnn can't be longer than this, since V0 is a byte
+const size_t MAX_TABLE_ENTRIES = 128;
+
+Cfg::Cfg(const uint8_t* memory, size_t size, uint16_t entry)
+	: memory(memory, memory + std::min(size, (size_t)0x10000))
+	, entry(entry)
+	, code(this->memory.size())
+	, covered(this->memory.size())
+	, leader(this->memory.size())
+	, target(this->memory.size())
+{
+	traverse();
+	build_blocks();
+}
+
+const std::vector<Cfg::Block>& Cfg::get_blocks() const {
+	return blocks;
+}
+
+const Cfg::Block* Cfg::get_block(uint16_t addr) const {
+	auto it = std::lower_bound(blocks.begin(), blocks.end(), addr,
+		[](const Block& b, uint16_t addr){ return b.start < addr; });
+	if (it == blocks.end() || it->start != addr)
+		return NULL;
+	return &*it;
+}
+
+const std::vector<uint16_t>& Cfg::get_functions() const {
+	return functions;
+}
+
+bool Cfg::is_code(uint16_t addr) const {
+	return addr < code.size() && code[addr];
+}
+
+bool Cfg::is_covered(uint16_t addr) const {
+	return addr < covered.size() && covered[addr];
+}
+
+bool Cfg::is_target(uint16_t addr) const {
+	return addr < target.size() && target[addr];
+}
+
+uint16_t Cfg::fetch(uint16_t addr) const {
+	return (memory[addr] << 8) | memory[addr+1];
+}
+
+std::vector<uint16_t> Cfg::table_targets(uint16_t addr) const {
+	// The entry for V0 = 0 is taken even if it isn't a jump
+	std::vector<uint16_t> targets;
+	for (size_t i = 0; i < MAX_TABLE_ENTRIES; i++){
+		uint16_t entry_addr = addr + i*2;
+		if (size_t(entry_addr) + 1 >= memory.size())
+			break;
+		if (i > 0 && decode_inst(fetch(entry_addr)).op != OP_JP)
+			break;
+		targets.push_back(entry_addr);
+	}
+	return targets;
+}
+
+void Cfg::traverse(){
+	std::vector<uint16_t> pending;
+	auto add_target = [&](uint16_t addr, bool jump = true){
+		if (size_t(addr) + 1 >= memory.size())
+			return;
+		leader[addr] = true;
+		target[addr] = target[addr] || jump;
+		pending.push_back(addr);
+	};
+	add_target(entry);
+
+	while (!pending.empty()){
+		uint16_t addr = pending.back();
+		pending.pop_back();
+
+		// Follow the instructions in sequence until the flow stops or gets
+		// to an instruction already visited
+		while (size_t(addr) + 1 < memory.size() && !code[addr]){
+			code[addr] = covered[addr] = covered[addr+1] = true;
+			Inst inst = decode_inst(fetch(addr));
+			uint16_t next = addr + 2;
+			bool stop = false;
+			switch (inst.op){
+				case OP_JP:
+					add_target(inst.nnn);
+					stop = true;
+					break;
+
+				case OP_CALL:
+					add_target(inst.nnn);
+					functions.push_back(inst.nnn);
+					if (size_t(next) + 1 < memory.size())
+						leader[next] = true;
+					break;
+
+				case OP_SE_BYTE: case OP_SNE_BYTE: case OP_SE_REG:
+				case OP_SNE_REG: case OP_SKP: case OP_SKNP:
+					add_target(next + 2, false);
+					if (size_t(next) + 1 < memory.size())
+						leader[next] = true;
+					break;
+
+				case OP_JP_V0:
+					for (uint16_t t : table_targets(inst.nnn))
+						add_target(t);
+					stop = true;
+					break;
+
+				case OP_RET:
+				case OP_UNKNOWN:
+					stop = true;
+					break;
+
+				default:
+					break;
+			}
+			if (stop)
+				break;
+			addr = next;
+		}
+	}
+
+	std::sort(functions.begin(), functions.end());
+	functions.erase(std::unique(functions.begin(), functions.end()),
+	                functions.end());
+}
+
+void Cfg::build_blocks(){
+	for (size_t start = 0; start < memory.size(); start++){
+		if (!leader[start] || !code[start])
+			continue;
+
+		Block block = { (uint16_t)start, 0, {}, 0, false, false, false };
+		uint16_t addr = start;
+		while (true){
+			Inst inst = decode_inst(fetch(addr));
+			uint16_t next = addr + 2;
+			bool ends = true;
+			switch (inst.op){
+				case OP_JP:
+					block.succs.push_back(inst.nnn);
+					break;
+
+				case OP_CALL:
+					block.call = inst.nnn;
+					block.succs.push_back(next);
+					break;
+
+				case OP_SE_BYTE: case OP_SNE_BYTE: case OP_SE_REG:
+				case OP_SNE_REG: case OP_SKP: case OP_SKNP:
+					block.succs.push_back(next);
+					block.succs.push_back(next + 2);
+					break;
+
+				case OP_JP_V0:
+					block.indirect = true;
+					block.succs = table_targets(inst.nnn);
+					break;
+
+				case OP_RET:
+					block.ret = true;
+					break;
+
+				case OP_UNKNOWN:
+					block.invalid = true;
+					break;
+
+				default:
+					ends = false;
+			}
+			addr = next;
+			if (ends)
+				break;
+
+			// Fall through into the next block, or out of memory
+			if (size_t(addr) + 1 >= memory.size())
+				break;
+			if (leader[addr]){
+				block.succs.push_back(addr);
+				break;
+			}
+		}
+		block.end = addr;
+
+		// Successors out of memory aren't blocks
+		auto out = [&](uint16_t succ){ return !is_code(succ); };
+		block.succs.erase(std::remove_if(block.succs.begin(),
+		                                 block.succs.end(), out),
+		                  block.succs.end());
+		blocks.push_back(block);
+	}
+}
+
+void Cfg::write_dot(FILE* f) const {
+	fprintf(f, "digraph cfg {\n");
+	fprintf(f, "\tnode [shape=box, fontname=monospace];\n");
+	char disass[32];
+	for (const Block& block : blocks){
+		fprintf(f, "\tb%03X [label=\"", block.start);
+		if (block.start == entry)
+			fprintf(f, "START\\l");
+		else if (std::binary_search(functions.begin(), functions.end(),
+		                            block.start))
+			fprintf(f, "FUNCTION 0x%X\\l", block.start);
+		for (uint16_t addr = block.start; addr < block.end; addr += 2){
+			disass_inst(fetch(addr), disass, sizeof(disass));
+			fprintf(f, "%04X: %s\\l", addr, disass);
+		}
+		fprintf(f, "\"];\n");
+	}
+	for (const Block& block : blocks){
+		for (uint16_t succ : block.succs)
+			fprintf(f, "\tb%03X -> b%03X;\n", block.start, succ);
+		if (block.call && is_code(block.call))
+			fprintf(f, "\tb%03X -> b%03X [style=dashed];\n", block.start,
+			        block.call);
+	}
+	fprintf(f, "}\n");
+}
@@ -0,0 +1,92 @@
+#ifndef _CFG_H
+#define _CFG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Control flow graph of a CHIP-8 program. It is built by recursive
+// traversal: starting at the entry point, instructions are followed through
+// jumps, calls and both ways of skips, so bytes that are never reached, such
+// as sprites, are left out as data.
+//
+// Basic blocks end like in the emulator, at the first instruction that may
+// change the control flow (1nnn, 2nnn, 00EE, Bnnn and skips), or before an
+// instruction that is the target of a branch. Calls are assumed to return.
+// Targets of Bnnn are guessed: they are taken as a jump table at nnn, with
+// one entry for each 1nnn found there.
+//
+// The analysis is static, so code that is written at runtime isn't found.
+class Cfg {
+	public:
+		struct Block {
+			uint16_t start; // Address of the first instruction
+			uint16_t end;   // Address after the last instruction
+
+			// Start of the blocks that may run after this one, not counting
+			// calls and returns
+			std::vector<uint16_t> succs;
+
+			// Address called by 2nnn at the end of the block, or 0
+			uint16_t call;
+
+			// Ends with 00EE, with Bnnn, or with an unknown instruction
+			bool ret;
+			bool indirect;
+			bool invalid;
+		};
+
+		// Analyze the program in `memory`, of `size` bytes, which starts at
+		// `entry`. Usually `memory` is the whole address space
+		Cfg(const uint8_t* memory, size_t size, uint16_t entry = 0x200);
+
+		// Blocks sorted by address
+		const std::vector<Block>& get_blocks() const;
+
+		// Block starting at `addr`, or NULL
+		const Block* get_block(uint16_t addr) const;
+
+		// Addresses called by 2nnn, sorted
+		const std::vector<uint16_t>& get_functions() const;
+
+		// Does a reachable instruction start at `addr`?
+		bool is_code(uint16_t addr) const;
+
+		// Is `addr` part of a reachable instruction? Bytes that aren't are
+		// data
+		bool is_covered(uint16_t addr) const;
+
+		// Is `addr` the target of a jump or a call, or the entry point?
+		bool is_target(uint16_t addr) const;
+
+		// Write the graph in Graphviz DOT format. Each block is a node with
+		// its instructions. Calls are dashed edges
+		void write_dot(FILE* f) const;
+
+	private:
+		std::vector<uint8_t> memory;
+		uint16_t entry;
+
+		// Per address: start of a reachable instruction, covered by one,
+		// start of a block and target of a jump
+		std::vector<bool> code;
+		std::vector<bool> covered;
+		std::vector<bool> leader;
+		std::vector<bool> target;
+
+		std::vector<Block> blocks;
+		std::vector<uint16_t> functions;
+
+		uint16_t fetch(uint16_t addr) const;
+
+		// Targets of the Bnnn jump table at `addr`
+		std::vector<uint16_t> table_targets(uint16_t addr) const;
+
+		// Find the reachable instructions and the block leaders
+		void traverse();
+
+		// Split the reachable instructions into blocks
+		void build_blocks();
+};
+
+#endif
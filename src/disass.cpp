@@ -3,322 +3,369 @@
 #include <cstdint>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
 #include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "cfg.h"
+#include "inst.h"
+#include "thread_pool.h"
+
+// Disassembles one ROM, or many of them in parallel. The output is a text
+// listing, or an index of the code of every ROM in JSON or in binary.
+//
+// The binary index is little endian. It starts with the magic "C8DX". Then,
+// for each ROM:
+//   u16 path length, path
+//   u32 size of the ROM
+//   u32 number of functions, u16 address of each one
+//   u32 number of instructions, and for each one u16 address, u16 opcode
+//       and u8 operation, as in `Op`
+// Instructions are only the reachable ones, sorted by address. It ends with a
+// u16 path length of 0, so it can be written to a pipe as ROMs are done.
+
+// ROMs are loaded at this address, in a 4KB address space
+const uint16_t ROM_START = 0x200;
+const size_t   MEM_SIZE  = 0x1000;
+
+// ROMs disassembled before writing their output
+const size_t BATCH_SIZE = 256;
+
+enum Format { FORMAT_TEXT, FORMAT_JSON, FORMAT_BIN };
 
 void error(const char* msg){
 	perror(msg);
 	exit(EXIT_FAILURE);
 }
 
-int main(int argc, char** argv){
-	if (argc != 2){
-		fprintf(stderr, "Usage: %s romfile\n", argv[0]);
-		exit(EXIT_FAILURE);
-	}
-	
-	printf("Loading %s\n", argv[1]);
-
-	// Open file
-	int fd = open(argv[1], O_RDONLY);
-	if (fd == -1)
-		error("open");
+void usage(const char* prog){
+	fprintf(stderr, "Usage: %s [-j threads] [-f text|json|bin] [-o output] "
+	                "[-g graph.dot] rom-dir | romfile...\n", prog);
+	fprintf(stderr, "  -g  write the control flow graph, with a single ROM\n");
+	exit(EXIT_FAILURE);
+}
 
-	// Get file size
-	int size = lseek(fd, 0, SEEK_END);
-	lseek(fd, 0, SEEK_SET);
-	if (size == -1)
-		error("lseek getting file size");
-	printf("File size %d\n", size);
+bool is_dir(const char* path){
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
 
-	// Load file content
-	uint8_t* memory = new uint8_t[size];
-	if (read(fd, memory, size) != size)
-		error("read");
-	close(fd);
-	
-	// For each call, record the called address
-	bool calls[size/2];
-	memset(calls, 0, sizeof(calls));
-	for (int pc = 0; pc < size-1; pc += 2){
-		uint16_t inst   = (memory[pc] << 8) | (memory[pc+1]);
-		uint8_t  opcode = (inst & 0xF000) >> 12;
-		uint16_t nnn    = inst & 0x0FFF;
-		if (opcode == 0x2)
-			if (nnn - 0x200 >= size)
-				fprintf(stderr, "ERROR Call out of bounds: Calling %p at %p, max addr is %p\n", nnn, pc+0x200, size+0x200);
-			else
-				calls[(nnn-0x200)/2] = true;
+// List the files in `dir`, sorted
+std::vector<std::string> list_roms(const char* dir){
+	std::vector<std::string> roms;
+	DIR* d = opendir(dir);
+	if (!d)
+		error(dir);
+	while (struct dirent* entry = readdir(d)){
+		if (entry->d_name[0] != '.')
+			roms.push_back(std::string(dir) + "/" + entry->d_name);
 	}
+	closedir(d);
+	std::sort(roms.begin(), roms.end());
+	return roms;
+}
 
-	// Disassemble
-	printf("\nSTART:\n");
-	char disass[32];
-	for (int pc = 0; pc < size-1; pc += 2){
-		// Fetch instruction and get opcode
-		uint16_t inst   = (memory[pc] << 8) | (memory[pc+1]);
-		uint8_t  opcode = (inst & 0xF000) >> 12;
-
-		// Auxiliary values
-		uint16_t nnn = inst & 0x0FFF;
-		uint8_t  n   = inst & 0x000F;
-		uint8_t  kk  = inst & 0x00FF;
-		uint8_t  x   = (inst & 0x0F00) >> 8; 
-		uint8_t  y   = (inst & 0x00F0) >> 4;
-
-		switch (opcode){
-			case 0x0:
-				switch (kk){
-					case 0xE0:
-						// 00E0 - CLS
-						// Clear the display.
-						snprintf(disass, sizeof(disass), "cls");
-						break;
-
-					case 0xEE:
-						// 00EE - RET
-						// Return from a subroutine.
-						snprintf(disass, sizeof(disass), "ret");
-						break;
-
-					default:
-						snprintf(disass, sizeof(disass), "Unknown inst 0: 0x%X", inst);
-						break;
-				}
-				break;
-
-			case 0x1:
-				// 1nnn - JP   addr
-				// Jump to location nnn.
-				snprintf(disass, sizeof(disass), "jp    0x%X", nnn);
-				break;
-
-			case 0x2:
-				// 2nnn - CALL addr
-				// Call subroutine at nnn.
-				snprintf(disass, sizeof(disass), "call  0x%X", nnn);
-				break;
-
-			case 0x3:
-				// 3xkk - SE Vx, byte
-				// Skip next instruction if Vx = kk.
-				snprintf(disass, sizeof(disass), "se    V%d, 0x%X", x, kk);
-				break;
-
-			case 0x4:
-				// 4xkk - SNE Vx, byte
-				// Skip next instruction if Vx != kk.
-				snprintf(disass, sizeof(disass), "sne   V%d, 0x%X", x, kk);
-				break;
-				
-			case 0x5:
-				// 5xy0 - SE Vx, Vy
-				// Skip next instruction if Vx = Vy.
-				snprintf(disass, sizeof(disass), "se    V%d, V%d", x, y);
-				break;
-
-			case 0x6: 
-				// 6xkk - ld    Vx, byte
-				// Set Vx = kk.
-				snprintf(disass, sizeof(disass), "ld    V%d, 0x%X", x, kk);
-				break;
-
-			case 0x7:
-				// 7xkk - ADD Vx, byte
-				// Set Vx = Vx + kk.
-				snprintf(disass, sizeof(disass), "add   V%d, 0x%X", x, kk);
-				break;
-
-			case 0x8:
-				switch (n){
-					case 0x0:
-						// 8xy0 - ld    Vx, Vy
-						// Set Vx = Vy.
-						snprintf(disass, sizeof(disass), "ld    V%d, V%d", x, y);
-						break;
-					
-					case 0x1:
-						// 8xy1 - OR Vx, Vy
-						// Set Vx = Vx OR Vy.
-						snprintf(disass, sizeof(disass), "or    V%d, V%d", x, y);
-						break;
-
-					case 0x2:
-						// 8xy2 - AND Vx, Vy
-						// Set Vx = Vx AND Vy.
-						snprintf(disass, sizeof(disass), "and   V%d, V%d", x, y);
-						break;
-
-					case 0x3:
-						// 8xy3 - XOR Vx, Vy
-						// Set Vx = Vx XOR Vy.
-						snprintf(disass, sizeof(disass), "xor   V%d, V%d", x, y);
-						break;
-
-					case 0x4:
-						// 8xy4 - ADD Vx, Vy
-						// Set Vx = Vx ADD Vy.
-						snprintf(disass, sizeof(disass), "add   V%d, V%d", x, y);
-						break;
-
-					case 0x5:
-						// 8xy5 - SUB Vx, Vy
-						// Set Vx = Vx - Vy, set VF = NOT borrow.
-						snprintf(disass, sizeof(disass), "sub   V%d, V%d", x, y);
-						break;
-
-					case 0x6:
-						// 8xy6 - SHR Vx {, Vy}
-						// Set Vx = Vx SHR 1.
-						snprintf(disass, sizeof(disass), "shr   V%d {, V%d}", x, y);
-						break;
-
-					case 0x7:
-						// 8xy7 - SUBN Vx, Vy
-						// Set Vx = Vy - Vx, set VF = NOT borrow.
-						snprintf(disass, sizeof(disass), "subn  V%d, V%d", x, y);
-						break;
-
-					case 0xE:
-						// 8xyE - SHL Vx {, Vy}
-						// Set Vx = Vx SHL 1.
-						snprintf(disass, sizeof(disass), "shl   V%d {, V%d}", x, y);
-						break;
-
-					default:
-						snprintf(disass, sizeof(disass), "Unknown inst 8: 0x%X", inst);
-						break;
-				}
-				break;
-
-			case 0x9:
-				// 9xy0 - SNE Vx, Vy
-				// Skip next instruction if Vx != Vy.
-				snprintf(disass, sizeof(disass), "sne   V%d, V%d", x, y);
-				break;
-
-			case 0xA:
-				// Annn - ld    I, addr
-				// Set I = nnn.
-				snprintf(disass, sizeof(disass), "ld    I, 0x%X", nnn);
-				break;
-
-			case 0xB:
-				// Bnnn - JP   V0, addr
-				// Jump to location nnn + V0.
-				snprintf(disass, sizeof(disass), "jp    V0, 0x%X", nnn);
-				break;
-
-			case 0xC:
-				// Cxkk - RND Vx, byte
-				// Set Vx = random byte AND kk.
-				snprintf(disass, sizeof(disass), "rnd   V%d, 0x%X", x, kk);
-				break;
+// Load the ROM `path` into `memory` at ROM_START. Returns its size, or -1
+// with `err` set
+int load_rom(const char* path, uint8_t* memory, std::string& err){
+	int fd = open(path, O_RDONLY);
+	if (fd == -1){
+		err = std::string("open: ") + strerror(errno);
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1){
+		err = std::string("stat: ") + strerror(errno);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size > (off_t)(MEM_SIZE - ROM_START)){
+		err = "ROM too big, max size is " + std::to_string(MEM_SIZE - ROM_START);
+		close(fd);
+		return -1;
+	}
 
-			case 0xD:
-				// Dxyn - DRW Vx, Vy, nibble
-				// Display n-byte sprite starting at memory location I at (Vx, Vy),
-				// set VF = collision.
-				snprintf(disass, sizeof(disass), "drw   V%d, V%d, 0x%X", x, y, n);
-				break;
+	int size = st.st_size;
+	if (size > 0){
+		void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED){
+			err = std::string("mmap: ") + strerror(errno);
+			close(fd);
+			return -1;
+		}
+		memcpy(memory + ROM_START, p, size);
+		munmap(p, size);
+	}
+	close(fd);
+	return size;
+}
 
-			case 0xE:
-				switch (kk){
-					case 0x9E:
-						// Ex9E - SKP Vx
-						// Skip next instruction if key with the value of Vx is
-						// pressed.
-						snprintf(disass, sizeof(disass), "skp   V%d", x);
-						break;
+// Append `value` in hex with `digits` digits
+void put_hex(std::string& out, uint value, int digits){
+	static const char hex[] = "0123456789ABCDEF";
+	for (int shift = (digits-1)*4; shift >= 0; shift -= 4)
+		out += hex[(value >> shift) & 0xF];
+}
 
-					case 0xA1:
-						// ExA1 - SKNP Vx
-						// Skip next instruction if key with the value of Vx is not
-						// pressed.
-						snprintf(disass, sizeof(disass), "sknp  V%d", x);
-						break;
+void put_u16(std::string& out, uint16_t value){
+	out += (char)(value & 0xFF);
+	out += (char)(value >> 8);
+}
 
-					default:
-						snprintf(disass, sizeof(disass), "Unknown inst E: 0x%X", inst);
-						break;
-				}
-				break;
+void put_u32(std::string& out, uint32_t value){
+	put_u16(out, value & 0xFFFF);
+	put_u16(out, value >> 16);
+}
 
-			case 0xF:
-				switch (kk){
-					case 0x07:
-						// Fx07 - ld    Vx, DT
-						// Set Vx = delay timer value.
-						snprintf(disass, sizeof(disass), "ld    V%d, DT", x);
-						break;
-					
-					case 0x0A:
-						// Fx0A - ld    Vx, K
-						// Wait for a key press, store the value of the key in Vx.
-						snprintf(disass, sizeof(disass), "ld    V%d, K", x);
-						break;
+// Append `s` as a JSON string
+void put_json_string(std::string& out, const char* s){
+	out += '"';
+	for (; *s; s++){
+		if (*s == '"' || *s == '\\'){
+			out += '\\';
+			out += *s;
+		} else if ((unsigned char)*s < 0x20){
+			out += "\\u00";
+			put_hex(out, *s, 2);
+		} else
+			out += *s;
+	}
+	out += '"';
+}
 
-					case 0x15:
-						// Fx15 - ld    DT, Vx
-						// Set delay timer = Vx.
-						snprintf(disass, sizeof(disass), "ld    DT, V%d", x);
-						break;
+// Write the listing of `size` bytes of ROM in `memory` into `out`
+void write_text(const Cfg& cfg, const uint8_t* memory, int size,
+                std::string& out){
+	// Disassemble code, and dump the rest as data with its bits drawn, since
+	// it's mostly sprites
+	out += "\nSTART:\n";
+	const std::vector<uint16_t>& functions = cfg.get_functions();
+	char text[DISASS_MAX];
+	uint16_t end = ROM_START + size;
+	for (uint16_t addr = ROM_START; addr < end; ){
+		bool code = cfg.is_code(addr) && addr+1 < end;
+		if (code && std::binary_search(functions.begin(), functions.end(), addr)){
+			out += "\nFUNCTION 0x";
+			put_hex(out, addr, 3);
+			out += ":\n";
+		} else if (code && cfg.is_target(addr) && addr != ROM_START){
+			out += "LABEL 0x";
+			put_hex(out, addr, 3);
+			out += ":\n";
+		}
 
-					case 0x18:
-						// Fx18 - ld    ST, Vx
-						// Set sound timer = Vx.
-						snprintf(disass, sizeof(disass), "ld    ST, V%d", x);
-						break;
+		out += "    ";
+		put_hex(out, addr, 4);
+		out += ":     ";
+		if (code){
+			uint16_t inst = (memory[addr] << 8) | memory[addr+1];
+			put_hex(out, inst, 4);
+			out += "       ";
+			out.append(text, format_inst(inst, text) - text);
+			addr += 2;
+		} else {
+			put_hex(out, memory[addr], 2);
+			out += "         db    0x";
+			put_hex(out, memory[addr], 2);
+			out += "  ";
+			for (int i = 0; i < 8; i++)
+				out += (memory[addr] & (0x80 >> i) ? '#' : '.');
+			addr++;
+		}
+		out += '\n';
+	}
+}
 
-					case 0x1E:
-						// Fx1E - ADD I, Vx
-						// Set I = I + Vx. 
-						snprintf(disass, sizeof(disass), "add   I, V%d", x);
-						break;
+// Write the code of `size` bytes of ROM in `memory` as a JSON object: the
+// functions and an array of `[address, opcode, assembly]`
+void write_json(const Cfg& cfg, const uint8_t* memory, const char* path,
+                int size, std::string& out){
+	out += "  {\"rom\": ";
+	put_json_string(out, path);
+	out += ", \"size\": " + std::to_string(size) + ", \"functions\": [";
+	const std::vector<uint16_t>& functions = cfg.get_functions();
+	for (size_t i = 0; i < functions.size(); i++){
+		if (i > 0)
+			out += ", ";
+		out += std::to_string(functions[i]);
+	}
+	out += "],\n   \"code\": [";
+
+	char text[DISASS_MAX];
+	bool first = true;
+	for (uint16_t addr = ROM_START; addr+1 < ROM_START + size; addr++){
+		if (!cfg.is_code(addr))
+			continue;
+		uint16_t inst = (memory[addr] << 8) | memory[addr+1];
+		out += (first ? "[" : ", [");
+		out += std::to_string(addr) + ", " + std::to_string(inst) + ", \"";
+		out.append(text, format_inst(inst, text) - text);
+		out += "\"]";
+		first = false;
+	}
+	out += "]}";
+}
 
-					case 0x29:
-						// Fx29 - ld    F, Vx
-						// Set I = location of sprite for digit Vx.
-						snprintf(disass, sizeof(disass), "ld    F, V%d", x);
-						break;
+// Write the code of `size` bytes of ROM in `memory` as a binary record, see
+// the format at the top
+void write_bin(const Cfg& cfg, const uint8_t* memory, const char* path,
+               int size, std::string& out){
+	// Paths are never empty, an empty one ends the index
+	size_t path_len = std::min(strlen(path), (size_t)0xFFFF);
+	put_u16(out, path_len);
+	out.append(path, path_len);
+	put_u32(out, size);
+
+	const std::vector<uint16_t>& functions = cfg.get_functions();
+	put_u32(out, functions.size());
+	for (uint16_t func : functions)
+		put_u16(out, func);
+
+	size_t count_pos = out.size();
+	put_u32(out, 0);
+	uint32_t count = 0;
+	for (uint16_t addr = ROM_START; addr+1 < ROM_START + size; addr++){
+		if (!cfg.is_code(addr))
+			continue;
+		uint16_t inst = (memory[addr] << 8) | memory[addr+1];
+		put_u16(out, addr);
+		put_u16(out, inst);
+		out += (char)decode_inst(inst).op;
+		count++;
+	}
+	std::string count_bytes;
+	put_u32(count_bytes, count);
+	out.replace(count_pos, 4, count_bytes);
+}
 
-					case 0x33:
-						// Fx33 - ld    B, Vx
-						// Store BCD representation of Vx in memory locations 
-						// I, I+1, and I+2.
-						snprintf(disass, sizeof(disass), "ld    B, V%d", x);
-						break;
+// Disassemble `path` into `out`. Returns false if it can't be loaded
+bool disassemble(const char* path, Format format, const char* dot_path,
+                 std::string& out){
+	uint8_t memory[MEM_SIZE] = {0};
+	std::string err;
+	int size = load_rom(path, memory, err);
+	if (size < 0){
+		fprintf(stderr, "%s: %s\n", path, err.c_str());
+		return false;
+	}
 
-					case 0x55:
-						// Fx55 - ld    [I], Vx
-						// Store registers V0 through Vx in memory starting at
-						// location I.
-						snprintf(disass, sizeof(disass), "ld    [I], V%d", x);
-						break;
+	// Find the code reachable from the start
+	Cfg cfg(memory, MEM_SIZE, ROM_START);
+	for (uint16_t func : cfg.get_functions())
+		if (func < ROM_START || func >= ROM_START + size)
+			fprintf(stderr, "%s: ERROR Call out of bounds: Calling 0x%X, max addr is 0x%X\n",
+			        path, func, ROM_START + size);
+
+	if (dot_path){
+		FILE* f = fopen(dot_path, "w");
+		if (!f)
+			error(dot_path);
+		cfg.write_dot(f);
+		fclose(f);
+	}
 
-					case 0x65:
-						// Fx65 - ld    Vx, [I]
-						// Read registers V0 through Vx from memory starting at
-						// location I.
-						snprintf(disass, sizeof(disass), "ld    V%d, [I]", x);
-						break;
+	switch (format){
+		case FORMAT_TEXT:
+			out += "Loading ";
+			out += path;
+			out += "\nFile size " + std::to_string(size) + "\n";
+			write_text(cfg, memory, size, out);
+			break;
+		case FORMAT_JSON:
+			write_json(cfg, memory, path, size, out);
+			break;
+		case FORMAT_BIN:
+			write_bin(cfg, memory, path, size, out);
+			break;
+	}
+	return true;
+}
 
-					default:
-						snprintf(disass, sizeof(disass), "Unknown inst F: 0x%X", inst);
-						break;
-				}
+int main(int argc, char** argv){
+	// Parse options
+	uint threads = 0;
+	Format format = FORMAT_TEXT;
+	const char* out_path = NULL;
+	const char* dot_path = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:f:o:g:")) != -1){
+		switch (opt){
+			case 'j': threads = atoi(optarg); break;
+			case 'o': out_path = optarg; break;
+			case 'g': dot_path = optarg; break;
+			case 'f':
+				if (!strcmp(optarg, "text"))
+					format = FORMAT_TEXT;
+				else if (!strcmp(optarg, "json"))
+					format = FORMAT_JSON;
+				else if (!strcmp(optarg, "bin"))
+					format = FORMAT_BIN;
+				else
+					usage(argv[0]);
 				break;
-
 			default:
-				snprintf(disass, sizeof(disass), "Unknown opcode: 0x%X", opcode);
-				break;
+				usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		usage(argv[0]);
+
+	std::vector<std::string> roms;
+	if (argc - optind == 1 && is_dir(argv[optind]))
+		roms = list_roms(argv[optind]);
+	else
+		roms.assign(argv + optind, argv + argc);
+	if (dot_path && roms.size() != 1)
+		usage(argv[0]);
+
+	FILE* out = stdout;
+	if (out_path && !(out = fopen(out_path, "wb")))
+		error(out_path);
+
+	if (format == FORMAT_JSON)
+		fputs("[\n", out);
+	else if (format == FORMAT_BIN)
+		fputs("C8DX", out);
+
+	// Disassemble in batches, writing the output of each one in order
+	ThreadPool pool(threads);
+	std::vector<std::string> outputs(std::min(roms.size(), BATCH_SIZE));
+	std::vector<char> loaded(outputs.size());
+	uint32_t n_written = 0;
+	bool failed = false;
+	for (size_t start = 0; start < roms.size(); start += BATCH_SIZE){
+		size_t n = std::min(BATCH_SIZE, roms.size() - start);
+		pool.run(n, [&](size_t i, uint thread){
+			outputs[i].clear();
+			loaded[i] = disassemble(roms[start+i].c_str(), format, dot_path,
+			                        outputs[i]);
+		});
+		for (size_t i = 0; i < n; i++){
+			if (!loaded[i]){
+				failed = true;
+				continue;
+			}
+			if (format == FORMAT_JSON && n_written > 0)
+				fputs(",\n", out);
+			else if (format == FORMAT_TEXT && n_written > 0)
+				fputs("\n", out);
+			fwrite(outputs[i].data(), 1, outputs[i].size(), out);
+			n_written++;
 		}
-
-		if (calls[pc/2])
-			printf("\nFUNCTION 0x%X:\n", pc+0x200);
-		printf("    %04X:     %04X       %s\n", pc+0x200, inst, disass);
 	}
 
-	delete[] memory;
-}
\ No newline at end of file
+	if (format == FORMAT_JSON)
+		fputs("\n]\n", out);
+	else if (format == FORMAT_BIN){
+		std::string end;
+		put_u16(end, 0);
+		fwrite(end.data(), 1, end.size(), out);
+	}
+	if (out != stdout)
+		fclose(out);
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
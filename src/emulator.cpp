@@ -1,12 +1,17 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
 #include <assert.h>
-#include <fcntl.h>
-#include <unistd.h>
 
 #include <chrono>
 #include <thread>
 
 #include "emulator.h"
+#include "rom_cache.h"
+#include "rng.h"
+#include "sprite.h"
 
 const uint8_t font[0x10*5] = {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -27,39 +32,89 @@ const uint8_t font[0x10*5] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-const SDL_Keycode Emulator::KEYMAP[0x10] = {
-	SDLK_x,  // 0
-	SDLK_1,  // 1
-	SDLK_2,  // 2
-	SDLK_3,  // 3
-	SDLK_q,  // 4
-	SDLK_w,  // 5
-	SDLK_e,  // 6
-	SDLK_a,  // 7
-	SDLK_s,  // 8
-	SDLK_d,  // 9
-	SDLK_z,  // A
-	SDLK_c,  // B
-	SDLK_4,  // C
-	SDLK_r,  // D
-	SDLK_f,  // E
-	SDLK_v,  // F
+const uint8_t big_font[0x10*10] = {
+	0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+	0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+	0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+	0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+	0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+	0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+	0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+	0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+	0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
 };
 
-void error(const char* msg){
-	perror(msg);
-	exit(EXIT_FAILURE);
+// Rotate `value` right `n` bits
+static inline unsigned __int128 rotr128(unsigned __int128 value, unsigned n){
+	return (n ? (value >> n) | (value << (128 - n)) : value);
 }
 
-void error_sdl(const char* msg){
-	printf("%s: %s\n", msg, SDL_GetError());
-	exit(EXIT_FAILURE);
+// Double every bit of the 16 bits of `bits`, for low resolution sprites
+static uint32_t double_bits(uint16_t bits){
+	uint32_t result = 0;
+	for (int i = 0; i < 16; i++)
+		if (bits & (1 << i))
+			result |= 3u << (i*2);
+	return result;
+}
+
+bool EmulatorBase::parse_backend(const char* name, Backend& backend){
+	if (!strcmp(name, "switch"))
+		backend = BACKEND_SWITCH;
+	else if (!strcmp(name, "threaded"))
+		backend = BACKEND_THREADED;
+	else if (!strcmp(name, "jit"))
+		backend = BACKEND_JIT;
+	else
+		return false;
+	return true;
+}
+
+template <class V>
+void BasicEmulator<V>::raise_fault(const char* fmt, ...){
+	char msg[128];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	char where[32];
+	snprintf(where, sizeof(where), " at 0x%X", pc);
+	fault   = std::string(msg) + where;
+	running = false;
+}
+
+template <class V>
+const std::string& BasicEmulator<V>::get_fault() const {
+	return fault;
 }
 
-Emulator::Emulator(const char* filename){
+template <class V>
+bool BasicEmulator<V>::idle() const {
+	return waiting_key && !rewind_requested && delay_timer == 0 &&
+	       sound_timer == 0;
+}
+
+template <class V>
+const EmulatorBase::Stats& BasicEmulator<V>::get_stats() const {
+	return stats;
+}
+
+template <class V>
+bool BasicEmulator<V>::is_running() const {
+	return running;
+}
+
+template <class V>
+BasicEmulator<V>::BasicEmulator(const char* filename, Frontend& frontend, RomCache* cache){
 	// Init everything
-	memset(memory, 0, sizeof(memory));
-	memcpy(memory, font, sizeof(font));
 	memset(regs, 0, sizeof(regs));
 	memset(stack, 0, sizeof(stack));
 	I           = 0;
@@ -68,467 +123,685 @@ Emulator::Emulator(const char* filename){
 	delay_timer = 0;
 	sound_timer = 0;
 	should_draw = false;
-	running     = false;
+	dirty_rows  = 0;
+	running     = true;
+	rewind_requested = false;
+	turbo        = false;
+	skip_present = false;
+	backend     = BACKEND_SWITCH;
 	keys.reset();
-	framebuf.reset();
-	init_sdl(basename(filename));
-	srand(time(NULL));
-
-	// Load ROM into memory
-	load(filename);
-}
-
-Emulator::~Emulator(){
-	destroy_sdl();
-}
-
-void Emulator::init_sdl(const char* game_name){
-	// Create window name
-	char window_name[32];
-	snprintf(window_name, sizeof(window_name), "CHIP-8 Emu: %s", game_name);
-
-	// Init SDL
-	memset(&sdl, 0, sizeof(sdl));
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
-		error_sdl("SDL_Init");
-
-	// Create window
-	sdl.window = SDL_CreateWindow(window_name, SDL_WINDOWPOS_UNDEFINED, 
-	                              SDL_WINDOWPOS_UNDEFINED, FRAMEBUF_W*20, 
-	                              FRAMEBUF_H*20, SDL_WINDOW_SHOWN);
-	if (sdl.window == NULL)
-		error_sdl("SDL_CreateWindow");
-
-	// Create renderer
-	sdl.renderer = SDL_CreateRenderer(sdl.window, -1, 0);
-	SDL_RenderSetLogicalSize(sdl.renderer, FRAMEBUF_W*20, FRAMEBUF_H*20);
-
-	// Create texture that stores frame buffer
-	sdl.texture = SDL_CreateTexture(sdl.renderer, SDL_PIXELFORMAT_ARGB8888,
-	                                SDL_TEXTUREACCESS_STREAMING, FRAMEBUF_W,
-	                                FRAMEBUF_H);
-
-	// Load audio
-	SDL_LoadWAV("beep.wav", &sdl.spec, &sdl.audio_buf, &sdl.audio_len);
-	if (!sdl.audio_buf || !sdl.audio_len)
-		error_sdl("SDL_LoadWAV");
-
-	sdl.audio_dev = SDL_OpenAudioDevice(NULL, 0, &sdl.spec, NULL, 0);
-	if (!sdl.audio_dev)
-		error_sdl("SDL_OpenAudioDevice");
-
-	SDL_PauseAudioDevice(sdl.audio_dev, 0);
-}
-
-void Emulator::destroy_sdl(){
-	SDL_DestroyTexture(sdl.texture);
-	SDL_DestroyRenderer(sdl.renderer);
-	SDL_CloseAudioDevice(sdl.audio_dev);
-	SDL_FreeWAV(sdl.audio_buf);
-	SDL_DestroyWindow(sdl.window);
-	SDL_Quit();
-}
-
-void Emulator::load(const char* filename){
-	// Open file
-	int fd = open(filename, O_RDONLY);
-	if (fd == -1)
-		error("open");
-
-	// Get file size
-	int size = lseek(fd, 0, SEEK_END);
-	lseek(fd, 0, SEEK_SET);
-	if (size == -1)
-		error("lseek getting file size");
-	
-	assert(sizeof(memory)-0x200 >= size);
-
-	// Load file content into memory
-	if (read(fd, &memory[0x200], size) != size)
-		error("read");
-
-	close(fd);
-}
-
-bool Emulator::display_sprite(uint16_t addr, uint8_t size, uint8_t x, uint8_t y){
-	assert(size <= 15);  // max sprite size is 8x15
-	assert(addr <= sizeof(memory)-size);
-
-	bool pixel_erased = false;
-	uint8_t c, draw_x, draw_y;
-	for (int i = 0; i < size; i++){
-		c = memory[addr+i];
-		for (int j = 0; j < 8; j++){
-			if (c & (1 << (7-j))){
-				// Set `pixel_erased` to true if the bit is set, and flip it
-				draw_x = (x+j) % FRAMEBUF_W;
-				draw_y = (y+i) % FRAMEBUF_H;
-				pixel_erased |= framebuf[draw_x + draw_y*FRAMEBUF_W];
-				framebuf[draw_x + draw_y*FRAMEBUF_W].flip();
+	memset(framebuf, 0, sizeof(framebuf));
+	this->frontend = &frontend;
+	rom_path = filename;
+	movie    = NULL;
+	memset(&stats, 0, sizeof(stats));
+#ifdef CHIP8_PROFILE
+	profiler = NULL;
+#endif
+	waiting_key = false;
+	set_seed(time(NULL));
+	if constexpr (V::SCHIP){
+		this->hires  = false;
+		this->planes = 1;
+		this->pitch  = 64;
+		memset(this->rpl, 0, sizeof(this->rpl));
+		memset(this->pattern, 0, sizeof(this->pattern));
+	}
+
+	// Map the ROM memory image and its decoded instructions. If it can't be
+	// loaded, the emulator is left stopped with a fault and only the fonts
+	// in memory
+	static const uint8_t empty = 0;
+	if constexpr (CLASSIC){
+		static_assert(Memory::SIZE == Rom::MEM_SIZE, "memory size mismatch");
+		static const Rom no_rom("", &empty, 0, 0);
+		rom = (cache ? cache->get(filename, fault) : load_rom(filename, fault));
+		if (rom)
+			memory.map(rom->memory, rom->decoded);
+		else {
+			running = false;
+			memory.map(no_rom.memory, no_rom.decoded);
+		}
+	} else {
+		this->image = load_rom_image<V>(filename, fault);
+		if (!this->image){
+			running = false;
+			this->image = std::make_shared<RomImage<V>>(&empty, 0);
+		}
+		memory.map(this->image->memory, this->image->decoded);
+	}
+}
+
+template <class V>
+BasicEmulator<V>::~BasicEmulator(){
+}
+
+template <class V>
+bool BasicEmulator<V>::display_sprite(uint16_t addr, uint8_t size, uint8_t x, uint8_t y){
+	assert(addr <= Memory::SIZE-size); // checked by Dxyn
+
+	// Mark the rows we are drawing into as dirty
+	y %= FRAMEBUF_H;
+	uint64_t rows_mask = ((1ULL << size) - 1) << y;
+	dirty_rows |= (uint32_t)rows_mask | (uint32_t)(rows_mask >> FRAMEBUF_H);
+
+	stats.sprites++;
+	stats.sprite_rows += size;
+
+	uint8_t buf[16];
+	const uint8_t* sprite = memory.view(addr, buf, size);
+	return draw_sprite(framebuf, sprite, size, x, y);
+}
+
+// Display helpers of the extended variants. Their bodies are empty in the
+// CHIP-8 emulator, which draws and clears the screen as it always did
+
+template <class V>
+uint16_t BasicEmulator<V>::sprite_size(uint8_t n) const {
+	if constexpr (V::SCHIP)
+		return (n ? n : 32) * __builtin_popcount(this->planes);
+	return n;
+}
+
+template <class V>
+bool BasicEmulator<V>::display_sprite_ext(uint16_t addr, uint8_t n, uint8_t x,
+                                          uint8_t y){
+	if constexpr (V::SCHIP){
+		static_assert(ROW_WORDS == 2, "framebuf rows must be 128 bits");
+		typedef unsigned __int128 Row;
+
+		// In low resolution mode coordinates and pixels are doubled. The
+		// sprite starts inside the screen, and wraps around the edges
+		int scale  = (this->hires ? 1 : 2);
+		int width  = (n ? 8 : 16);
+		int height = (n ? n : 16);
+		int left   = (x % (V::SCREEN_W / scale)) * scale;
+		int top    = (y % (V::SCREEN_H / scale)) * scale;
+
+		uint8_t buf[32*V::PLANES];
+		const uint8_t* sprite = memory.view(addr, buf, sprite_size(n));
+		bool collision = false;
+		for (int p = 0; p < V::PLANES; p++){
+			if (!(this->planes & (1 << p)))
+				continue;
+			uint64_t* plane = &framebuf[p*V::SCREEN_H*ROW_WORDS];
+			for (int i = 0; i < height; i++, sprite += width/8){
+				// Row of the sprite at the left of the screen row, rotated
+				uint32_t bits = (n ? sprite[0] : (sprite[0] << 8) | sprite[1]);
+				if (scale == 2)
+					bits = double_bits(bits);
+				Row row = rotr128((Row)bits << (128 - width*scale), left);
+				for (int j = 0; j < scale; j++){
+					int dst_y = (top + i*scale + j) % V::SCREEN_H;
+					uint64_t* dst = &plane[dst_y*ROW_WORDS];
+					Row old = ((Row)dst[0] << 64) | dst[1];
+					collision |= (old & row) != 0;
+					old ^= row;
+					dst[0] = old >> 64;
+					dst[1] = old;
+					dirty_rows |= 1ULL << dst_y;
+				}
 			}
 		}
+		stats.sprites++;
+		stats.sprite_rows += height;
+		return collision;
 	}
-	return pixel_erased;
+	return false;
 }
 
-void Emulator::update_timers(){
+template <class V>
+void BasicEmulator<V>::clear_planes(){
+	if constexpr (V::SCHIP){
+		const int PLANE_WORDS = V::SCREEN_H*ROW_WORDS;
+		for (int p = 0; p < V::PLANES; p++)
+			if (this->planes & (1 << p))
+				memset(&framebuf[p*PLANE_WORDS], 0, PLANE_WORDS*sizeof(uint64_t));
+	}
+}
+
+template <class V>
+void BasicEmulator<V>::scroll(int dx, int dy){
+	if constexpr (V::SCHIP){
+		typedef unsigned __int128 Row;
+		const int H = V::SCREEN_H, ROW_SIZE = ROW_WORDS*sizeof(uint64_t);
+		if (!this->hires){
+			dx *= 2;
+			dy *= 2;
+		}
+
+		// Pixels that come in are blank
+		for (int p = 0; p < V::PLANES; p++){
+			if (!(this->planes & (1 << p)))
+				continue;
+			uint64_t* plane = &framebuf[p*H*ROW_WORDS];
+			if (dy > 0){
+				memmove(&plane[dy*ROW_WORDS], plane, (H-dy)*ROW_SIZE);
+				memset(plane, 0, dy*ROW_SIZE);
+			} else if (dy < 0){
+				memmove(plane, &plane[-dy*ROW_WORDS], (H+dy)*ROW_SIZE);
+				memset(&plane[(H+dy)*ROW_WORDS], 0, -dy*ROW_SIZE);
+			}
+			if (dx == 0)
+				continue;
+			for (int y = 0; y < H; y++){
+				uint64_t* dst = &plane[y*ROW_WORDS];
+				Row row = ((Row)dst[0] << 64) | dst[1];
+				row = (dx > 0 ? row >> dx : row << -dx);
+				dst[0] = row >> 64;
+				dst[1] = row;
+			}
+		}
+	}
+}
+
+template <class V>
+uint16_t BasicEmulator<V>::skip_size() const {
+	if constexpr (V::XO)
+		return (memory.fetch(pc+2).op == OP_LD_I_LONG ? 6 : 4);
+	return 4;
+}
+
+template <class V>
+void BasicEmulator<V>::update_timers(){
 	if (delay_timer > 0) delay_timer--;
-	if (sound_timer > 0 && --sound_timer == 0) // Play sound
-	    if (SDL_QueueAudio(sdl.audio_dev, sdl.audio_buf, sdl.audio_len) == -1)
-			error_sdl("SDL_QueueAudio");
+	// The buzzer sounds during every frame in which the sound timer is set,
+	// unless it's muted in turbo mode
+	bool sound = sound_timer > 0;
+	if (sound) sound_timer--;
+	frontend->set_sound(sound && !turbo);
 }
 
-void Emulator::update_screen(){
+template <class V>
+void BasicEmulator<V>::update_screen(){
 	// Update screen only when needed
-	if (!should_draw)
+	if (!should_draw || skip_present)
 		return;
 
-	// Get the pixels from the framebuf
-	uint32_t pixels[FRAMEBUF_H*FRAMEBUF_W];
-	for (int i = 0; i < FRAMEBUF_H*FRAMEBUF_W; i++)
-		pixels[i] = (framebuf[i] ? 0xFFFFFFFF : 0xFF000000);
-	
-	// Draw pixels
-	SDL_UpdateTexture(sdl.texture, NULL, pixels, FRAMEBUF_W*sizeof(uint32_t));
-	//SDL_RenderClear(sdl.renderer);
-	SDL_RenderCopy(sdl.renderer, sdl.texture, NULL, NULL);
-	SDL_RenderPresent(sdl.renderer);
-	
-	// Update flag
+	frontend->update_screen(framebuf, dirty_rows);
+
+	// Update flags
 	should_draw = false;
+	dirty_rows  = 0;
 }
 
-void Emulator::update_keys(){
-	SDL_Event e;
-	while (SDL_PollEvent(&e) != 0){
-		if (e.type == SDL_QUIT)
-			running = false; // exit
-
-		// Keep which keys are pressed and which aren't
-		else if (e.type == SDL_KEYDOWN){
-			for (int i = 0; i < 16; i++)
-				if (e.key.keysym.sym == KEYMAP[i])
-					keys[i] = 1;
-
-		} else if (e.type == SDL_KEYUP){
-			for (int i = 0; i < 16; i++)
-				if (e.key.keysym.sym == KEYMAP[i])
-					keys[i] = 0;
+template <class V>
+void BasicEmulator<V>::update_keys(){
+	uint32_t commands = frontend->update_keys(keys);
+	if (commands & Frontend::CMD_QUIT)
+		running = false; // exit
+	rewind_requested = (commands & Frontend::CMD_REWIND);
+	if (commands & Frontend::CMD_TURBO)
+		set_turbo(!turbo);
+
+	// Only CHIP-8 states fit in State
+	if constexpr (CLASSIC){
+		State state;
+		std::string filename;
+		if (commands & Frontend::CMD_SAVE_STATE){
+			filename = state_filename(frontend->slot);
+			save_state(state);
+			if (write_state_file(state, filename.c_str()))
+				printf("Saved state to %s\n", filename.c_str());
+			else
+				perror(("Saving state to " + filename).c_str());
 		}
-	}
+		if (commands & Frontend::CMD_LOAD_STATE){
+			filename = state_filename(frontend->slot);
+			if (read_state_file(state, filename.c_str())){
+				// Keep the keys the user is pressing now
+				state.keys = keys.to_ulong();
+				load_state(state);
+				printf("Loaded state from %s\n", filename.c_str());
+				if (movie)
+					printf("Warning: the movie being recorded won't replay correctly\n");
+			} else
+				perror(("Loading state from " + filename).c_str());
+		}
+	} else if (commands & (Frontend::CMD_SAVE_STATE | Frontend::CMD_LOAD_STATE))
+		printf("Save states are only supported in CHIP-8\n");
 }
 
-uint8_t Emulator::wait_for_key_press(){
-	while (keys.none() && running)
-		update_keys();
+template <class V>
+uint8_t BasicEmulator<V>::lowest_key_pressed(){
+	assert(keys.any());
 	for (int i = 0; i < 16; i++)
 		if (keys[i])
 			return i;
-	
-	// We get here if `running` was cleared. Doesn't matter, we're exiting.
 	return -1;
 }
 
-void Emulator::run_instruction(){
-	assert(pc >= 0 && pc < sizeof(memory)-1);
-	assert(sp >= 0 && sp < sizeof(stack)/sizeof(stack[0]));
-
-	// Get instruction and opcode
-	uint16_t inst   = (memory[pc] << 8) | (memory[pc+1]);
-	uint8_t  opcode = (inst & 0xF000) >> 12;
-
-	// Auxiliary values
-	uint16_t nnn = inst & 0x0FFF;
-	uint8_t  n   = inst & 0x000F;
-	uint8_t  kk  = inst & 0x00FF;
-	uint8_t  x   = (inst & 0x0F00) >> 8;
-	uint8_t  y   = (inst & 0x00F0) >> 4;
-
-	switch (opcode){
-		case 0x0:
-			switch (kk){
-				case 0xE0:
-					// 00E0 - CLS
-					// Clear the display.
-					framebuf.reset();
-					break;
-
-				case 0xEE:
-					// 00EE - RET
-					// Return from a subroutine.
-					pc = stack[sp--];
-					break;
-
-				default:
-					fprintf(stderr, "Unknown inst 0 at 0x%X: 0x%X\n", pc, inst);
-					exit(EXIT_FAILURE);
-			}
-			pc += 2;
-			break;
-
-		case 0x1:
-			// 1nnn - JP addr
-			// Jump to location nnn.
-			pc = nnn;
-			break;
-
-		case 0x2:
-			// 2nnn - CALL addr
-			// Call subroutine at nnn.
-			stack[++sp] = pc;
-			pc = nnn;
-			break;
-
-		case 0x3:
-			// 3xkk - SE Vx, byte
-			// Skip next instruction if Vx = kk.
-			pc += (regs[x] == kk ? 4 : 2);
-			break;
-
-		case 0x4:
-			// 4xkk - SNE Vx, byte
-			// Skip next instruction if Vx != kk.
-			pc += (regs[x] != kk ? 4 : 2);
-			break;
-			
-		case 0x5:
-			// 5xy0 - SE Vx, Vy
-			// Skip next instruction if Vx = Vy.
-			pc += (regs[x] == regs[y] ? 4 : 2);
-			break;
-
-		case 0x6: 
-			// 6xkk - LD Vx, byte
-			// Set Vx = kk.
-			regs[x] = kk;
-			pc += 2;
-			break;
-
-		case 0x7:
-			// 7xkk - ADD Vx, byte
-			// Set Vx = Vx + kk.
-			regs[x] += kk;
-			pc += 2;
-			break;
-
-		case 0x8:
-			switch (n){
-				case 0x0:
-					// 8xy0 - LD Vx, Vy
-					// Set Vx = Vy.
-					regs[x] = regs[y];
-					break;
-				
-				case 0x1:
-					// 8xy1 - OR Vx, Vy
-					// Set Vx = Vx OR Vy.
-					regs[x] |= regs[y];
-					break;
-
-				case 0x2:
-					// 8xy2 - AND Vx, Vy
-					// Set Vx = Vx AND Vy.
-					regs[x] &= regs[y];
-					break;
-
-				case 0x3:
-					// 8xy3 - XOR Vx, Vy
-					// Set Vx = Vx XOR Vy.
-					regs[x] ^= regs[y];
-					break;
-
-				case 0x4:
-					// 8xy4 - ADD Vx, Vy
-					// Set Vx = Vx ADD Vy.
-					regs[0xF] = ((uint16_t)regs[x] + regs[y] > 255);
-					regs[x] += regs[y];
-					break;
-
-				case 0x5:
-					// 8xy5 - SUB Vx, Vy
-					// Set Vx = Vx - Vy, set VF = NOT borrow.
-					regs[0xF] = (regs[x] >= regs[y]);
-					regs[x] -= regs[y];
-					break;
-
-				case 0x6:
-					// 8xy6 - SHR Vx {, Vy}
-					// Set Vx = Vx SHR 1.
-					regs[0xF] = regs[x] & 1;
-					regs[x] >>= 1;
-					break;
-
-				case 0x7:
-					// 8xy7 - SUBN Vx, Vy
-					// Set Vx = Vy - Vx, set VF = NOT borrow.
-					regs[0xF] = (regs[y] >= regs[x]);
-					regs[x] = regs[y] - regs[x];
-					break;
-
-				case 0xE:
-					// 8xyE - SHL Vx {, Vy}
-					// Set Vx = Vx SHL 1.
-					regs[0xF] = regs[x] >> 7;
-					regs[x] <<= 1;
-					break;
-
-				default:
-					fprintf(stderr, "Unknown inst 8 at 0x%X: 0x%X\n", pc, inst);
-					exit(EXIT_FAILURE);
-			}
-			
-			pc += 2;
-			break;
-
-		case 0x9:
-			// 9xy0 - SNE Vx, Vy
-			// Skip next instruction if Vx != Vy.
-			pc += (regs[x] != regs[y] ? 4 : 2);
-			break;
-
-		case 0xA:
-			// Annn - LD I, addr
-			// Set I = nnn.
-			I = nnn;
-			pc += 2;
-			break;
-
-		case 0xB:
-			// Bnnn - JP V0, addr
-			// Jump to location nnn + V0.
-			pc = regs[0] + nnn;
-			break;
-
-		case 0xC:
-			// Cxkk - RND Vx, byte
-			// Set Vx = random byte AND kk.
-			regs[x] = rand() & kk;
-			pc += 2;
-			break;
-
-		case 0xD:
-			// Dxyn - DRW Vx, Vy, nibble
-			// Display n-byte sprite starting at memory location I at (Vx, Vy),
-			// set VF = collision.
-			should_draw = true;
-			regs[0xF] = display_sprite(I, n, regs[x], regs[y]);
-			pc += 2;
-			break;
-
-		case 0xE:
-			switch (kk){
-				case 0x9E:
-					// Ex9E - SKP Vx
-					// Skip next instruction if key with the value of Vx is
-					// pressed.
-					pc += (keys[regs[x]] ? 4 : 2);
-					break;
-
-				case 0xA1:
-					// ExA1 - SKNP Vx
-					// Skip next instruction if key with the value of Vx is not
-					// pressed.
-					pc += (!keys[regs[x]] ? 4 : 2);
-					break;
-
-				default:
-					fprintf(stderr, "Unknown inst E at 0x%X: 0x%X\n", pc, inst);
-					exit(EXIT_FAILURE);
-			}
-			break;
-
-		case 0xF:
-			switch (kk){
-				case 0x07:
-					// Fx07 - LD Vx, DT
-					// Set Vx = delay timer value.
-					regs[x] = delay_timer;
-					break;
-				
-				case 0x0A:
-					// Fx0A - LD Vx, K
-					// Wait for a key press, store the value of the key in Vx.
-					regs[x] = wait_for_key_press();
-					break;
-
-				case 0x15:
-					// Fx15 - LD DT, Vx
-					// Set delay timer = Vx.
-					delay_timer = regs[x];
-					break;
-
-				case 0x18:
-					// Fx18 - LD ST, Vx
-					// Set sound timer = Vx.
-					sound_timer = regs[x];
-					break;
-
-				case 0x1E:
-					// Fx1E - ADD I, Vx
-					// Set I = I + Vx. 
-					regs[0xF] = ((uint16_t)I + regs[x] > 255);
-					I += regs[x];
-					break;
-
-				case 0x29:
-					// Fx29 - LD F, Vx
-					// Set I = location of sprite for digit Vx.
-					assert(regs[x] <= 0xF); // last digit is F
-					I = regs[x]*5;
-					break;
-
-				case 0x33:
-					// Fx33 - LD B, Vx
-					// Store BCD representation of Vx in memory locations 
-					// I, I+1, and I+2.
-					assert(I <= sizeof(memory)-3);
-					memory[I]   = regs[x] / 100;
-					memory[I+1] = (regs[x] / 10) % 10;
-					memory[I+2] = (regs[x] % 10);
-					break;
-
-				case 0x55:
-					// Fx55 - LD [I], Vx
-					// Store registers V0 through Vx in memory starting at
-					// location I.
-					assert(I <= sizeof(memory)-x);
-					assert(x <= 15); // last register is V15 (regs[15])
-					memcpy(&memory[I], regs, x+1);
-					break;
-
-				case 0x65:
-					// Fx65 - LD Vx, [I]
-					// Read registers V0 through Vx from memory starting at
-					// location I.
-					assert(I <= sizeof(memory)-x);
-					assert(x <= 15); // last register is V15 (regs[15])
-					memcpy(regs, &memory[I], x+1);
-					break;
-
-				default:
-					fprintf(stderr, "Unknown inst F at 0x%X: 0x%X\n", pc, inst);
-					exit(EXIT_FAILURE);
+template <class V>
+void BasicEmulator<V>::set_seed(uint32_t seed){
+	rng = rng_init(seed);
+}
 
-			}
-			pc += 2;
-			break;
+template <class V>
+uint8_t BasicEmulator<V>::random_byte(){
+	return rng_next(rng);
+}
+
+template <class V>
+void BasicEmulator<V>::record(Movie* movie){
+	this->movie = movie;
+}
+
+#ifdef CHIP8_PROFILE
+template <class V>
+void BasicEmulator<V>::profile(Profiler* profiler){
+	this->profiler = profiler;
+}
+#endif
+
+template <class V>
+const uint64_t* BasicEmulator<V>::get_framebuf() const {
+	return framebuf;
+}
+
+template <class V>
+uint64_t BasicEmulator<V>::screen_hash() const {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (uint64_t row : framebuf)
+		for (int i = 0; i < 8; i++)
+			hash = (hash ^ ((row >> (i*8)) & 0xFF)) * 0x100000001b3;
+	return hash;
+}
+
+template <class V>
+void BasicEmulator<V>::write(uint16_t addr, const uint8_t* data, uint16_t len){
+	memory.write(addr, data, len);
+
+	// Throw away translated code that may have been overwritten
+	if (jit)
+		jit->invalidate(addr, addr+len);
+}
+
+template <class V>
+void BasicEmulator<V>::run_instruction(){
+	if (pc >= Memory::SIZE-1){
+		raise_fault("pc out of memory");
+		return;
+	}
+
+	// Get the decoded instruction and run it
+	const Inst* inst = &memory.fetch(pc);
+#ifdef CHIP8_PROFILE
+	if constexpr (CLASSIC)
+		if (profiler)
+			profiler->sample(pc, inst->op, stack, sp, memory);
+#endif
+	switch (inst->op){
+		#define INST(op) case op:
+		#define NEXT      break
+		#define END_BLOCK break
+		#include "instructions.inc"
+		#undef INST
+		#undef NEXT
+		#undef END_BLOCK
 
 		default:
-			fprintf(stderr, "Unknown opcode at 0x%X: 0x%X\n", pc, opcode);
-			exit(EXIT_FAILURE);
+			assert(false);
+	}
+}
+
+template <>
+void Emulator::save_state(State& state) const {
+	// Clear the padding too: rewind encodes the whole struct
+	memset(&state, 0, sizeof(state));
+	memory.read(0, state.memory, sizeof(state.memory));
+	memcpy(state.stack, stack, sizeof(stack));
+	memcpy(state.regs, regs, sizeof(regs));
+	state.I           = I;
+	state.sp          = sp;
+	state.pc          = pc;
+	state.delay_timer = delay_timer;
+	state.sound_timer = sound_timer;
+	state.keys        = keys.to_ulong();
+	memcpy(state.framebuf, framebuf, sizeof(framebuf));
+	state.rng         = rng;
+}
+
+template <>
+void Emulator::load_state(const State& state){
+	static_assert(sizeof(state.memory) == Memory::SIZE, "memory size");
+	static_assert(sizeof(state.framebuf) == sizeof(framebuf), "framebuf size");
+
+	// Write only the chunks of memory that changed, so pages that weren't
+	// written stay shared
+	const uint16_t CHUNK = 64;
+	for (uint16_t addr = 0; addr < Memory::SIZE; addr += CHUNK){
+		if (!memory.equal(addr, &state.memory[addr], CHUNK))
+			write(addr, &state.memory[addr], CHUNK);
 	}
+
+	memcpy(stack, state.stack, sizeof(stack));
+	memcpy(regs, state.regs, sizeof(regs));
+	I           = state.I;
+	sp          = state.sp;
+	pc          = state.pc;
+	delay_timer = state.delay_timer;
+	sound_timer = state.sound_timer;
+	keys        = state.keys;
+	memcpy(framebuf, state.framebuf, sizeof(framebuf));
+	rng         = state.rng;
+
+	// The whole screen may have changed
+	should_draw = true;
+	dirty_rows  = ALL_ROWS;
+}
+
+template <>
+void Emulator::enable_rewind(uint seconds){
+	if (seconds)
+		rewind.reset(new Rewind(seconds*FPS));
+	else
+		rewind.reset();
+}
+
+template <class V>
+std::string BasicEmulator<V>::state_filename(int slot) const {
+	return rom_path + ".state" + std::to_string(slot);
 }
 
-void Emulator::run(uint sleep_time){
-	running = true;
+// Use computed goto for the threaded interpreter if the compiler supports it.
+// Otherwise, fall back to a loop with a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define USE_COMPUTED_GOTO
+#endif
+
+template <class V>
+uint BasicEmulator<V>::run_block(uint max_inst){
+	const Inst* inst;
+	uint count = 0;
+
+#ifdef USE_COMPUTED_GOTO
+	// Address of the handler of each operation, in the order of `Op`
+	static const void* const handlers[] = {
+		&&OP_CLS, &&OP_RET, &&OP_JP, &&OP_CALL, &&OP_SE_BYTE, &&OP_SNE_BYTE,
+		&&OP_SE_REG, &&OP_LD_BYTE, &&OP_ADD_BYTE, &&OP_LD_REG, &&OP_OR,
+		&&OP_AND, &&OP_XOR, &&OP_ADD_REG, &&OP_SUB, &&OP_SHR, &&OP_SUBN,
+		&&OP_SHL, &&OP_SNE_REG, &&OP_LD_I, &&OP_JP_V0, &&OP_RND, &&OP_DRW,
+		&&OP_SKP, &&OP_SKNP, &&OP_LD_VX_DT, &&OP_LD_VX_K, &&OP_LD_DT_VX,
+		&&OP_LD_ST_VX, &&OP_ADD_I, &&OP_LD_F, &&OP_LD_B, &&OP_LD_MEM_VX,
+		&&OP_LD_VX_MEM, &&OP_SCD, &&OP_SCR, &&OP_SCL, &&OP_EXIT, &&OP_LOW,
+		&&OP_HIGH, &&OP_LD_HF, &&OP_LD_R_VX, &&OP_LD_VX_R, &&OP_SCU,
+		&&OP_SAVE, &&OP_LOAD, &&OP_LD_I_LONG, &&OP_PLANE, &&OP_AUDIO,
+		&&OP_PITCH, &&OP_UNKNOWN
+	};
+	static_assert(sizeof(handlers)/sizeof(handlers[0]) == OP_COUNT,
+	              "missing handlers");
+
+	// Each handler jumps directly to the next one. A fault fetching an
+	// instruction counts as running it, like in run_instruction()
+	#define DISPATCH()                                             \
+		do {                                                       \
+			if (pc >= Memory::SIZE-1){                        \
+				raise_fault("pc out of memory");                   \
+				return count+1;                                    \
+			}                                                      \
+			inst = &memory.fetch(pc);                              \
+			goto *handlers[inst->op];                              \
+		} while (0)
+	#define INST(op) op:
+	#define NEXT                                                   \
+		do {                                                       \
+			if (++count == max_inst)                               \
+				return count;                                      \
+			DISPATCH();                                            \
+		} while (0)
+	#define END_BLOCK return count+1
+
+	DISPATCH();
+	#include "instructions.inc"
+
+#else
+	#define INST(op) case op:
+	#define NEXT                                                   \
+		if (++count == max_inst)                                   \
+			return count;                                          \
+		continue
+	#define END_BLOCK return count+1
+
+	while (true){
+		if (pc >= Memory::SIZE-1){
+			raise_fault("pc out of memory");
+			return count+1;
+		}
+		inst = &memory.fetch(pc);
+		switch (inst->op){
+			#include "instructions.inc"
 
-	// Main loop. Each cycle we update keys state, run a single instruction,
-	// update timers and update the screen.
+			default:
+				assert(false);
+		}
+	}
+#endif
+
+	#undef DISPATCH
+	#undef INST
+	#undef NEXT
+	#undef END_BLOCK
+
+	// Unreachable
+	return count;
+}
+
+template <class V>
+void BasicEmulator<V>::set_backend(Backend backend){
+#ifdef CHIP8_PROFILE
+	// The profiler samples in run_instruction()
+	if (backend != BACKEND_SWITCH)
+		fprintf(stderr, "Profiling build, using switch interpreter\n");
+	backend = BACKEND_SWITCH;
+#endif
+	if (backend == BACKEND_JIT && !Jit::supported()){
+		fprintf(stderr, "JIT not supported, using threaded interpreter\n");
+		backend = BACKEND_THREADED;
+	}
+	if constexpr (CLASSIC){
+		if (backend == BACKEND_JIT && !jit){
+			jit.reset(Jit::create(*this));
+			if (!jit){
+				fprintf(stderr, "Can't allocate JIT code cache, using threaded interpreter\n");
+				backend = BACKEND_THREADED;
+			} else if (rom)
+				jit->translate(rom->cfg);
+		}
+	} else if (backend == BACKEND_JIT){
+		fprintf(stderr, "The JIT only runs CHIP-8, using threaded interpreter\n");
+		backend = BACKEND_THREADED;
+	}
+	this->backend = backend;
+}
+
+template <class V>
+uint BasicEmulator<V>::idle_loop_length(uint16_t addr) const {
+	if (addr >= Memory::SIZE-5)
+		return 0;
+	const Inst& inst = memory.fetch(addr);
+	const Inst& next = memory.fetch(addr+2);
+	if (inst.op == OP_JP)
+		return (inst.nnn == addr ? 1 : 0);
+	if (inst.op == OP_SKP || inst.op == OP_SKNP)
+		return (next.op == OP_JP && next.nnn == addr ? 2 : 0);
+	if (inst.op == OP_LD_VX_DT){
+		const Inst& jump = memory.fetch(addr+4);
+		bool skip = (next.op == OP_SE_BYTE || next.op == OP_SNE_BYTE);
+		return (skip && next.x == inst.x && jump.op == OP_JP &&
+		        jump.nnn == addr ? 3 : 0);
+	}
+	return 0;
+}
+
+template <class V>
+uint BasicEmulator<V>::skip_idle_loop(uint max_inst){
+#ifdef CHIP8_PROFILE
+	// Idle loops are part of the profile
+	if (profiler)
+		return 0;
+#endif
+	uint len = idle_loop_length(pc);
+	if (len == 0 || len > max_inst)
+		return 0;
+
+	// Check the loop doesn't exit. Every iteration leaves the same state: pc
+	// back at the loop, and Vx with the delay timer in the case of Fx07
+	const Inst& inst = memory.fetch(pc);
+	const Inst& next = memory.fetch(pc+2);
+	if (inst.op == OP_SKP || inst.op == OP_SKNP){
+		uint8_t key = regs[inst.x];
+		bool pressed = key <= 0xF && keys[key];
+		if (pressed != (inst.op == OP_SKNP))
+			return 0;
+	} else if (inst.op == OP_LD_VX_DT){
+		bool equal = (delay_timer == next.kk);
+		if (equal != (next.op == OP_SNE_BYTE))
+			return 0;
+		regs[inst.x] = delay_timer;
+	}
+
+	uint skipped = max_inst - max_inst%len;
+	stats.elided += skipped;
+	return skipped;
+}
+
+template <class V>
+uint BasicEmulator<V>::run_frame(uint inst_per_frame){
+	waiting_key = false;
+	update_keys();
+
+	// Go back one frame instead of running this one if the user asks to
+	// rewind. Keep the keys the user is pressing now
+	State state;
+	if constexpr (CLASSIC){
+		if (rewind && rewind_requested){
+			if (rewind->pop(state)){
+				state.keys = keys.to_ulong();
+				load_state(state);
+				if (movie)
+					movie->pop();
+			}
+			update_screen();
+			return 0;
+		}
+	}
+
+	if (movie)
+		movie->push(keys.to_ulong());
+
+	// Run instructions until the end of the frame, or until Fx0A halts the
+	// CPU waiting for a key. Idle loops can't exit until the next frame, so
+	// their iterations are skipped. They are looked for at the start of
+	// every block, but the switch interpreter only does it after jumping
+	// backwards, which is how they are entered, to keep it cheap
+	uint count = 0;
+	uint16_t last_pc = 0xFFFF;
+	while (count < inst_per_frame && running && !waiting_key){
+		uint skipped = 0;
+		if (pc <= last_pc)
+			skipped = skip_idle_loop(inst_per_frame - count);
+		if (skipped)
+			count += skipped;
+		else if (backend == BACKEND_THREADED)
+			count += run_block(inst_per_frame - count);
+		else if (backend == BACKEND_JIT){
+			// Run translated code, or a single instruction in the
+			// interpreter if it can't be run by the JIT
+			uint n = jit->run(inst_per_frame - count);
+			if (n == 0){
+				run_instruction();
+				n = 1;
+			}
+			count += n;
+		} else {
+			last_pc = pc;
+			run_instruction();
+			count++;
+		}
+	}
+	update_timers();
+	update_screen();
+	stats.frames++;
+	stats.instructions += count;
+
+	if constexpr (CLASSIC){
+		if (rewind){
+			save_state(state);
+			rewind->push(state);
+		}
+	}
+	return count;
+}
+
+template <class V>
+void BasicEmulator<V>::set_turbo(bool turbo){
+	this->turbo  = turbo;
+	skip_present = false;
+	printf("Turbo mode %s\n", turbo ? "on" : "off");
+}
+
+template <class V>
+void BasicEmulator<V>::run(uint inst_per_frame){
+	// Main loop. Each frame we update keys state, run a batch of
+	// instructions, update timers and update the screen. Then we sleep until
+	// the next frame deadline. Deadlines are absolute, computed from the
+	// start time and the number of frames, so they don't drift.
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	clock::time_point deadline;
+	uint64_t frame = 0;
+
+	// Turbo mode counts host frame periods since `start`: the one of the
+	// last frame, and the one and the frame when the speed was reported
+	uint64_t last_period = 0, reported = 0, reported_frame = 0;
 	while (running){
-		update_keys();
-		run_instruction();
-		update_timers();
-		update_screen();
-		std::this_thread::sleep_for(std::chrono::microseconds(sleep_time));
+		bool was_turbo = turbo;
+		run_frame(inst_per_frame);
+
+		// If the CPU is halted waiting for a key and the timers are stopped,
+		// nothing can change until there's input. Sleep until then instead
+		// of waking up every frame, and start counting frames again after.
+		// Also start again when turbo mode is toggled
+		if (idle() || turbo != was_turbo){
+			if (idle())
+				frontend->wait_input(-1);
+			start = clock::now();
+			frame = 0;
+			last_period = reported = reported_frame = 0;
+			continue;
+		}
+
+		frame++;
+		if (turbo){
+			// Don't sleep. Only the first frame of each host frame period
+			// is presented, and the speed is reported every second, as a
+			// multiple of FPS
+			clock::time_point now = clock::now();
+			uint64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				now - start).count() * FPS / 1000000000ULL;
+			skip_present = (period == last_period);
+			last_period  = period;
+			if (period >= reported + FPS){
+				printf("Turbo: %.1fx\n", (double)(frame - reported_frame) /
+				                         (period - reported));
+				reported       = period;
+				reported_frame = frame;
+			}
+			continue;
+		}
+		deadline = start + std::chrono::nanoseconds(frame*1000000000ULL/FPS);
+		if (clock::now() > deadline + std::chrono::milliseconds(100)){
+			// We are too late, probably because the host was suspended or
+			// too slow. Resync instead of running many frames in a row.
+			start = clock::now();
+			frame = 0;
+			continue;
+		}
+		std::this_thread::sleep_until(deadline);
 	}
-}
\ No newline at end of file
+}
+
+template class BasicEmulator<Chip8>;
+template class BasicEmulator<SuperChip>;
+template class BasicEmulator<XoChip>;
@@ -1,26 +1,113 @@
+#ifndef _EMULATOR_H
+#define _EMULATOR_H
+
 #include <cstdint>
 #include <bitset>
-#include <SDL2/SDL.h>
-
-struct SDL_Data {
-	SDL_Window*       window;
-	SDL_Renderer*     renderer;
-	SDL_Texture*      texture;
-	SDL_AudioSpec     spec;
-	uint32_t          audio_len;
-	uint8_t*          audio_buf;
-	SDL_AudioDeviceID audio_dev;
-};
+#include <memory>
+#include <string>
+#include "frontend.h"
+#include "guest_memory.h"
+#include "inst.h"
+#include "jit.h"
+#include "state.h"
+#include "rewind.h"
+#include "movie.h"
+#include "profiler.h"
+#include "variant.h"
+
+class RomCache;
+struct Rom;
+template <class V> struct RomImage;
+
+// Hex digits sprites, loaded at address 0
+extern const uint8_t font[0x10*5];
+
+// Big hex digits sprites of the extended variants, 8x10, loaded right after
+// the small ones
+const uint16_t BIG_FONT_START = 0x50;
+extern const uint8_t big_font[0x10*10];
 
-class Emulator {
+// Types and constants shared by the emulators of every variant
+class EmulatorBase {
 	public:
-		static const int FRAMEBUF_W = 64;
-		static const int FRAMEBUF_H = 32;
-		static const SDL_Keycode KEYMAP[0x10];
+		// Interpreter backends
+		enum Backend {
+			BACKEND_SWITCH,   // One switch dispatch per instruction
+			BACKEND_THREADED, // Direct-threaded dispatch, one block per call
+			BACKEND_JIT,      // x86-64 dynamic recompiler, see jit.h
+		};
+
+		// Execution statistics, since the emulator was created
+		struct Stats {
+			uint64_t frames;       // Frames run, not counting rewound ones
+			uint64_t instructions; // Instructions run
+			uint64_t sprites;      // Sprites drawn by Dxyn
+			uint64_t sprite_rows;  // Rows of those sprites
+			uint64_t elided;       // Instructions of idle loops skipped, also
+			                       // counted in `instructions`
+		};
+
+		// Instructions run per frame by default
+		static const uint DEFAULT_INST_PER_FRAME = 10;
+
+		// Frames per second. Timers are updated once per frame
+		static const uint FPS = 60;
+
+		// Get the backend called `name` ("switch", "threaded" or "jit").
+		// Returns false if there's no such backend
+		static bool parse_backend(const char* name, Backend& backend);
+};
+
+// State of the instructions of the extended variants. CHIP-8 has none, so
+// it takes no space in its emulator
+template <class V, bool = V::SCHIP>
+struct Extensions {};
+
+template <class V>
+struct Extensions<V, true> {
+	// Is the display in 128x64 mode? Otherwise it's 64x32, and every pixel
+	// is drawn as 2x2
+	bool hires;
+
+	// Planes drawn, cleared and scrolled, one bit each. Selected by Fn01 in
+	// XO-CHIP, it's always the first one in SUPER-CHIP
+	uint8_t planes;
+
+	// RPL user flags, saved and restored by Fx75 and Fx85
+	uint8_t rpl[16];
+
+	// XO-CHIP audio pattern and pitch. They are kept, but the buzzer is
+	// played as in CHIP-8
+	uint8_t pattern[16];
+	uint8_t pitch;
+
+	// ROM loaded at power on
+	std::shared_ptr<const RomImage<V>> image;
+};
 
+// Emulator of the CHIP-8 variant `V`, see variant.h. Each variant is a
+// different class, so the extended instructions and their state only exist
+// in the emulators that need them: Emulator, the CHIP-8 one, runs the same
+// code it would without them. Only CHIP-8 has the JIT backend, save states,
+// rewind and profiling.
+template <class V>
+class BasicEmulator : public EmulatorBase, private Extensions<V> {
 	private:
-		// Memory and stack. Sizes can be changed
-		uint8_t  memory[4096];
+		typedef BasicGuestMemory<V> Memory;
+
+		// Is this the classic CHIP-8 emulator?
+		static const bool CLASSIC = !V::SCHIP;
+
+		// Words of a framebuffer row, and dirty_rows with every row
+		static const int      ROW_WORDS = V::SCREEN_W / 64;
+		static const uint64_t ALL_ROWS  = ~0ULL >> (64 - V::SCREEN_H);
+
+		// Memory, with the decoded instruction at each address, even and
+		// odd. It's shared with other emulators running the same ROM until
+		// it's written with write()
+		Memory memory;
+
+		// Stack. Size can be changed
 		uint16_t stack[16];
 
 		// Registers
@@ -36,54 +123,234 @@ class Emulator {
 		// Keys state, bit set means pressed
 		std::bitset<0x10> keys;
 
-		// Pixels state, bit set means displayed
-		std::bitset<FRAMEBUF_W*FRAMEBUF_H> framebuf;
+		// State of the random number generator used by Cxkk
+		uint32_t rng;
 
-		// 
+		// Set when Fx0A halts the CPU until the next frame because no key
+		// is pressed
+		bool waiting_key;
+
+		// Pixels state, bit set means displayed. Each plane has SCREEN_H
+		// rows of ROW_WORDS words, and the most significant bit of the
+		// first word of a row is its leftmost pixel. CHIP-8 has one plane
+		// with a word per row
+		uint64_t framebuf[V::PLANES*V::SCREEN_H*ROW_WORDS];
+
+		// Rows of the framebuffer modified since the last screen update
+		uint64_t dirty_rows;
+
+		// Set when the framebuffer has been modified and the screen must be
+		// updated
 		bool should_draw;
 
-		// Is the emulator running? Set when run() is called, cleared when
-		// emulator window is closed.
+		// Is the emulator running? Cleared when the frontend asks to quit
+		// (for example, when the emulator window is closed) or when there's
+		// a fault.
 		bool running;
 
-		// SDL stuff
-		SDL_Data sdl;
+		// Error that stopped the emulator, empty if there's none
+		std::string fault;
+
+		// Video, audio and input
+		Frontend* frontend;
+
+		// Path of the ROM, used to name save state files
+		std::string rom_path;
+
+		// CHIP-8 ROM loaded at power on, shared with other emulators
+		std::shared_ptr<const Rom> rom;
+
+		// States of the last frames, if rewind is enabled
+		std::unique_ptr<Rewind> rewind;
+
+		// Set when the frontend asks to rewind
+		bool rewind_requested;
+
+		// In turbo mode run() doesn't sleep, the screen is only presented
+		// at FPS frames per second of host time and sound is muted
+		bool turbo;
+
+		// Set by run() in turbo mode for the frames that aren't presented.
+		// Their changes are presented with the next frame that is
+		bool skip_present;
+
+		// Movie where keys are recorded, if any
+		Movie* movie;
+
+		Stats stats;
 
-		// Initialize SDL stuff
-		void init_sdl(const char* game_name);
+#ifdef CHIP8_PROFILE
+		// Profiler that samples every instruction, if any
+		Profiler* profiler;
+#endif
 
-		// Free SDL stuff
-		void destroy_sdl();
+		// Interpreter backend used by run_frame()
+		Backend backend;
 
-		// Load a CHIP-8 ROM into memory
-		void load(const char* filename);
+		// Dynamic recompiler, created when BACKEND_JIT is selected
+		std::unique_ptr<Jit> jit;
+
+		// The JIT accesses the emulator state from translated code
+		friend class Jit;
+
+		// Stop the emulator because of an error in the running program, such
+		// as an invalid instruction or an access out of memory
+		void raise_fault(const char* fmt, ...)
+			__attribute__((format(printf, 2, 3)));
+
+		// Write `len` bytes of `data` at `addr`, which must be inside memory,
+		// and throw away the translated code it overwrites
+		void write(uint16_t addr, const uint8_t* data, uint16_t len);
 
 		// Display the sprite located at `addr` of `size` bytes at `x`, `y` 
 		// position. Returns whether there was a collision or not
 		bool display_sprite(uint16_t addr, uint8_t size, uint8_t x, uint8_t y);
 
-		// Update timers and play sound if needed
+		// display_sprite() of the extended variants, for Dxyn with `n`. The
+		// sprite is 16x16 if n is 0, and there's one after the other for
+		// each selected plane
+		bool display_sprite_ext(uint16_t addr, uint8_t n, uint8_t x, uint8_t y);
+
+		// Bytes of the sprite drawn by Dxyn with `n`
+		uint16_t sprite_size(uint8_t n) const;
+
+		// Clear the selected planes of the extended variants
+		void clear_planes();
+
+		// Scroll the selected planes of the extended variants `dx` pixels
+		// right and `dy` pixels down, or left and up if they are negative.
+		// They are low resolution pixels in that mode
+		void scroll(int dx, int dy);
+
+		// Bytes a skip instruction advances pc when it skips. XO-CHIP skips
+		// the two words of F000 nnnn
+		uint16_t skip_size() const;
+
+		// Update timers, and sound the buzzer while the sound timer is set
 		void update_timers();
 
 		// Draw `framebuf` into the screen and update it
 		void update_screen();
 
-		// Update the state of `keys`
+		// Update the state of `keys` and handle frontend commands
 		void update_keys();
 
-		// Wait for a key press
-		uint8_t wait_for_key_press();
+		// Get the lowest key pressed. There must be at least one
+		uint8_t lowest_key_pressed();
+
+		// Get a random byte
+		uint8_t random_byte();
+
+		// Is the CPU halted by Fx0A with the timers stopped? Then only input
+		// can make a difference
+		bool idle() const;
+
+		// Length in instructions of the polling loop at `addr`, or 0 if
+		// there's none. These are `1nnn` jumping to itself, `Fx07; 3xkk/4xkk;
+		// 1nnn` waiting for the delay timer and `Ex9E/ExA1; 1nnn` waiting for
+		// a key. Timers and keys only change between frames, so once one of
+		// them loops it does so until the end of the frame
+		uint idle_loop_length(uint16_t addr) const;
+
+		// If pc is at a polling loop that doesn't exit in this frame, skip as
+		// many whole iterations of it as fit in `max_inst` instructions.
+		// Returns the number of instructions skipped
+		uint skip_idle_loop(uint max_inst);
 
 		// Run one instruction
 		void run_instruction();
 
+		// Run instructions until the end of the current basic block or until
+		// `max_inst` instructions have been run, using the threaded
+		// interpreter. Returns the number of instructions run
+		uint run_block(uint max_inst);
+
 	public:
-		// Initialize the emulator state and load the CHIP-8 ROM into memory
-		Emulator(const char* filename);
+		// Initialize the emulator state and load the ROM into memory, from
+		// `cache` if it's given. Only CHIP-8 ROMs are cached. If the ROM
+		// can't be loaded, the emulator is stopped with a fault. `frontend`
+		// and `cache` must outlive the emulator
+		BasicEmulator(const char* filename, Frontend& frontend,
+		              RomCache* cache = NULL);
+
+		~BasicEmulator();
+
+		// Copy the emulator state into `state`, with its padding cleared.
+		// It's cheap enough to be called every frame. CHIP-8 only
+		void save_state(State& state) const;
+
+		// Restore the emulator state from `state`. Only memory that differs
+		// from the current one is copied and decoded again, so this is cheap
+		// when it's called with recent states. CHIP-8 only
+		void load_state(const State& state);
+
+		// Keep the states of the last `seconds` seconds so the user can
+		// rewind. 0 disables it. The other variants can't rewind
+		void enable_rewind(uint seconds);
+
+		// Seed the random number generator. It's seeded with the current
+		// time by default. Two emulators with the same seed, backend and
+		// input run exactly the same way
+		void set_seed(uint32_t seed);
+
+		// Record the keys of every frame into `movie`. NULL stops recording.
+		// `movie` must outlive the emulator
+		void record(Movie* movie);
+
+#ifdef CHIP8_PROFILE
+		// Sample every instruction into `profiler`. NULL stops profiling.
+		// Only the switch backend can be profiled
+		void profile(Profiler* profiler);
+#endif
+
+		// Get the framebuffer, see `framebuf`. For CHIP-8 it has one word
+		// per row, most significant bit first
+		const uint64_t* get_framebuf() const;
+
+		// Hash of the framebuffer, to compare runs
+		uint64_t screen_hash() const;
+
+		// Get the execution statistics
+		const Stats& get_stats() const;
+
+		// Is the emulator running? It stops when the frontend asks to quit
+		// or when there's a fault
+		bool is_running() const;
+
+		// Error that stopped the emulator, empty if there's none
+		const std::string& get_fault() const;
+
+		// Save state file for `slot`
+		std::string state_filename(int slot) const;
+
+		// Select the interpreter backend. Default is BACKEND_SWITCH. If
+		// BACKEND_JIT is not supported in this host or by the variant, or
+		// its code cache can't be allocated, BACKEND_THREADED is used
+		void set_backend(Backend backend);
+
+		// Run a single frame: update keys, run `inst_per_frame` instructions,
+		// update timers and update the screen. It doesn't sleep. Returns the
+		// number of instructions run, which is less than `inst_per_frame` if
+		// the CPU waits for a key or stops
+		uint run_frame(uint inst_per_frame);
+
+		// Turn turbo mode on or off. The frontend toggles it with CMD_TURBO
+		void set_turbo(bool turbo);
+
+		// Run the emulator at `FPS` frames per second, running
+		// `inst_per_frame` instructions each frame, until the frontend asks
+		// to quit. In turbo mode it runs as fast as possible, and prints the
+		// speed every second
+		void run(uint inst_per_frame = DEFAULT_INST_PER_FRAME);
+};
+
+typedef BasicEmulator<Chip8>     Emulator;
+typedef BasicEmulator<SuperChip> SuperChipEmulator;
+typedef BasicEmulator<XoChip>    XoChipEmulator;
 
-		// Free SDL stuff
-		~Emulator();
+// States only fit CHIP-8, so these are only defined for its emulator
+template <> void Emulator::save_state(State& state) const;
+template <> void Emulator::load_state(const State& state);
+template <> void Emulator::enable_rewind(uint seconds);
 
-		// Run the emulator waiting `sleep_time` microseconds between cycles
-		void run(uint sleep_time);
-};
\ No newline at end of file
+#endif
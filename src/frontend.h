@@ -0,0 +1,55 @@
+#ifndef _FRONTEND_H
+#define _FRONTEND_H
+
+#include <cstdint>
+#include <bitset>
+
+// Size of the CHIP-8 display in pixels
+const int FRAMEBUF_W = 64;
+const int FRAMEBUF_H = 32;
+
+// Interface between the emulator core and the outside world. A frontend is a
+// video sink, an audio sink and an input source. The core never talks to SDL
+// or any other library directly, so it can run without a display.
+class Frontend {
+	public:
+		// Commands a frontend can send to the emulator, as a bitmask returned
+		// by update_keys()
+		enum Command : uint32_t {
+			CMD_NONE = 0,
+			CMD_QUIT       = 1 << 0,
+			CMD_SAVE_STATE = 1 << 1, // Save state to `slot`
+			CMD_LOAD_STATE = 1 << 2, // Load state from `slot`
+			CMD_REWIND     = 1 << 3, // Go back one frame
+			CMD_TURBO      = 1 << 4, // Toggle turbo mode
+		};
+
+		// Save state slot for CMD_SAVE_STATE and CMD_LOAD_STATE
+		int slot;
+
+		Frontend() : slot(0) {}
+		virtual ~Frontend() {}
+
+		// Video sink. Draw `framebuf` into the screen. It has one word per
+		// row, and the most significant bit of each word is the leftmost
+		// pixel. The extended variants have wider rows of several words,
+		// and planes one after the other, see BasicEmulator. Bit i of
+		// `dirty_rows` is set if row i may have changed since the last call.
+		// Rows not in `dirty_rows` are guaranteed not to have changed
+		virtual void update_screen(const uint64_t* framebuf, uint64_t dirty_rows) = 0;
+
+		// Audio sink. Called once per frame: the buzzer sounds during the
+		// frame if `on` is set, and is silent otherwise
+		virtual void set_sound(bool on) = 0;
+
+		// Input source. Update the state of `keys` and return the commands
+		// requested by the user
+		virtual uint32_t update_keys(std::bitset<0x10>& keys) = 0;
+
+		// Block until there may be new input for update_keys(), or until
+		// `timeout_ms` milliseconds have passed. A negative timeout means
+		// no timeout. It may return early
+		virtual void wait_input(int timeout_ms) = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "frontend_null.h"
+#include "audio.h"
+
+NullFrontend::NullFrontend(){
+	keys.reset();
+	new_keys       = false;
+	screen_updates = 0;
+	samples        = 0;
+	sound_samples  = 0;
+}
+
+void NullFrontend::set_keys(uint16_t keys_mask){
+	std::lock_guard<std::mutex> guard(lock);
+	keys     = keys_mask;
+	new_keys = true;
+	keys_set.notify_all();
+}
+
+void NullFrontend::update_screen(const uint64_t* framebuf, uint64_t dirty_rows){
+	screen_updates++;
+}
+
+void NullFrontend::set_sound(bool on){
+	samples += SquareWave::SAMPLES_PER_FRAME;
+	if (on)
+		sound_samples += SquareWave::SAMPLES_PER_FRAME;
+}
+
+uint32_t NullFrontend::update_keys(std::bitset<0x10>& keys){
+	std::lock_guard<std::mutex> guard(lock);
+	keys     = this->keys;
+	new_keys = false;
+	return CMD_NONE;
+}
+
+void NullFrontend::wait_input(int timeout_ms){
+	std::unique_lock<std::mutex> guard(lock);
+	auto pred = [this]{ return new_keys; };
+	if (timeout_ms < 0)
+		keys_set.wait(guard, pred);
+	else
+		keys_set.wait_for(guard, std::chrono::milliseconds(timeout_ms), pred);
+}
@@ -0,0 +1,41 @@
+#ifndef _FRONTEND_NULL_H
+#define _FRONTEND_NULL_H
+
+#include <mutex>
+#include <condition_variable>
+#include "frontend.h"
+
+// Headless frontend. It doesn't display anything nor play any sound, it just
+// counts what it was asked to do. Keys can be set with set_keys(), also from
+// another thread, which wakes up wait_input().
+class NullFrontend : public Frontend {
+	private:
+		// Keys state that will be reported to the emulator
+		std::bitset<0x10> keys;
+
+		// Protect `keys`, and signal when they are set
+		std::mutex              lock;
+		std::condition_variable keys_set;
+		bool                    new_keys;
+
+	public:
+		// Number of times the video sink has been called
+		uint64_t screen_updates;
+
+		// Audio samples that would have been played, and how many of them
+		// were the tone. Samples are counted, not generated
+		uint64_t samples;
+		uint64_t sound_samples;
+
+		NullFrontend();
+
+		// Set the keys state reported by update_keys()
+		void set_keys(uint16_t keys_mask);
+
+		void update_screen(const uint64_t* framebuf, uint64_t dirty_rows);
+		void set_sound(bool on);
+		uint32_t update_keys(std::bitset<0x10>& keys);
+		void wait_input(int timeout_ms);
+};
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "frontend_sdl.h"
+
+const SDL_Keycode SDLFrontend::KEYMAP[0x10] = {
+	SDLK_x,  // 0
+	SDLK_1,  // 1
+	SDLK_2,  // 2
+	SDLK_3,  // 3
+	SDLK_q,  // 4
+	SDLK_w,  // 5
+	SDLK_e,  // 6
+	SDLK_a,  // 7
+	SDLK_s,  // 8
+	SDLK_d,  // 9
+	SDLK_z,  // A
+	SDLK_c,  // B
+	SDLK_4,  // C
+	SDLK_r,  // D
+	SDLK_f,  // E
+	SDLK_v,  // F
+};
+
+// Pixels for each value of a byte of the framebuffer, most significant bit
+// first
+struct PixelsLUT {
+	uint32_t pixels[256][8];
+
+	PixelsLUT(){
+		for (int value = 0; value < 256; value++)
+			for (int i = 0; i < 8; i++)
+				pixels[value][i] = (value & (0x80 >> i) ? 0xFFFFFFFF : 0xFF000000);
+	}
+};
+static const PixelsLUT lut;
+
+const uint32_t SDLFrontend::PALETTE[4] = {
+	0xFF000000, // Off
+	0xFFFFFFFF, // First plane
+	0xFFAAAAAA, // Second plane
+	0xFF555555, // Both
+};
+
+// Called by SDL from the audio thread to fill `stream` with `len` bytes
+static void audio_callback(void* userdata, uint8_t* stream, int len){
+	SquareWave* wave = (SquareWave*)userdata;
+	wave->generate((int16_t*)stream, len / sizeof(int16_t));
+}
+
+void error_sdl(const char* msg){
+	printf("%s: %s\n", msg, SDL_GetError());
+	exit(EXIT_FAILURE);
+}
+
+SDLFrontend::SDLFrontend(const char* game_name, int width, int height,
+                         int planes)
+	: width(width)
+	, height(height)
+	, planes(planes)
+	, n_words(planes*height*width/64)
+{
+	// Create window name
+	char window_name[32];
+	snprintf(window_name, sizeof(window_name), "CHIP-8 Emu: %s", game_name);
+
+	// Init SDL
+	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+		error_sdl("SDL_Init");
+
+	// Create window
+	window = SDL_CreateWindow(window_name, SDL_WINDOWPOS_UNDEFINED,
+	                          SDL_WINDOWPOS_UNDEFINED, FRAMEBUF_W*20,
+	                          FRAMEBUF_H*20, SDL_WINDOW_SHOWN);
+	if (window == NULL)
+		error_sdl("SDL_CreateWindow");
+
+	// Create renderer. Presenting waits for vsync, which only holds loop()
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+	if (renderer == NULL)
+		error_sdl("SDL_CreateRenderer");
+	SDL_RenderSetLogicalSize(renderer, FRAMEBUF_W*20, FRAMEBUF_H*20);
+
+	// Create texture that stores frame buffer
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+	                            SDL_TEXTUREACCESS_STREAMING, width, height);
+
+	// Start with a black screen
+	memset(shown, 0, sizeof(shown));
+	for (int i = 0; i < height*width; i++)
+		pixels[i] = PALETTE[0];
+	SDL_UpdateTexture(texture, NULL, pixels, width*sizeof(uint32_t));
+	SDL_RenderCopy(renderer, texture, NULL, NULL);
+	SDL_RenderPresent(renderer);
+
+	// Event pushed by other threads to wake up loop()
+	wake_event = SDL_RegisterEvents(1);
+	if (wake_event == (uint32_t)-1)
+		error_sdl("SDL_RegisterEvents");
+	stopped = false;
+
+	new_input    = false;
+	keys_down    = 0;
+	keys_up      = 0;
+	commands     = CMD_NONE;
+	command_slot = 0;
+	rewinding    = false;
+
+	// Open audio. Samples are generated by the callback as they are needed
+	SDL_AudioSpec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.freq     = SquareWave::SAMPLE_RATE;
+	spec.format   = AUDIO_S16SYS;
+	spec.channels = 1;
+	spec.samples  = AUDIO_SAMPLES;
+	spec.callback = audio_callback;
+	spec.userdata = &wave;
+
+	audio_dev = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
+	if (!audio_dev)
+		error_sdl("SDL_OpenAudioDevice");
+
+	SDL_PauseAudioDevice(audio_dev, 0);
+}
+
+SDLFrontend::~SDLFrontend(){
+	SDL_CloseAudioDevice(audio_dev);
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+}
+
+// Wake up loop() with an event of type `type`
+static void push_wake_event(uint32_t type){
+	SDL_Event e;
+	memset(&e, 0, sizeof(e));
+	e.type = type;
+	SDL_PushEvent(&e);
+}
+
+void SDLFrontend::update_screen(const uint64_t* framebuf, uint64_t dirty_rows){
+	if (!dirty_rows)
+		return;
+
+	// Publish the frame and wake up loop(), unless it's going to take a
+	// previous frame that wasn't taken yet: then it will take this one
+	// instead. This never blocks
+	Frame& frame = frames.write_buffer();
+	memcpy(frame.words, framebuf, n_words*sizeof(uint64_t));
+	if (frames.publish())
+		push_wake_event(wake_event);
+}
+
+void SDLFrontend::loop(){
+	// Frames published while presenting are skipped, only the newest one
+	// is drawn
+	while (!stopped){
+		SDL_Event e;
+		if (!SDL_WaitEvent(&e))
+			error_sdl("SDL_WaitEvent");
+		do
+			handle_event(e);
+		while (SDL_PollEvent(&e));
+		if (frames.update())
+			draw(frames.read_buffer().words);
+	}
+}
+
+void SDLFrontend::stop(){
+	stopped = true;
+	push_wake_event(wake_event);
+}
+
+void SDLFrontend::draw(const uint64_t* framebuf){
+	// Find the rows that actually changed, and convert them to pixels. With
+	// a single plane each byte is converted at once
+	const int row_words = width/64, plane_words = height*row_words;
+	int first = height, last = -1;
+	for (int y = 0; y < height; y++){
+		bool changed = false;
+		for (int p = 0; p < planes; p++){
+			for (int w = 0; w < row_words; w++){
+				int i = p*plane_words + y*row_words + w;
+				changed |= (framebuf[i] != shown[i]);
+				shown[i] = framebuf[i];
+			}
+		}
+		if (!changed)
+			continue;
+		uint32_t* row = &pixels[y*width];
+		if (planes == 1){
+			for (int w = 0; w < row_words; w++){
+				for (int i = 0; i < 8; i++){
+					uint8_t value = framebuf[y*row_words + w] >> (56 - i*8);
+					memcpy(&row[w*64 + i*8], lut.pixels[value],
+					       sizeof(lut.pixels[value]));
+				}
+			}
+		} else {
+			for (int x = 0; x < width; x++){
+				int color = 0;
+				for (int p = 0; p < planes; p++){
+					uint64_t word = framebuf[p*plane_words + y*row_words + x/64];
+					color |= ((word >> (63 - x%64)) & 1) << p;
+				}
+				row[x] = PALETTE[color];
+			}
+		}
+		if (first > y)
+			first = y;
+		last = y;
+	}
+
+	// Nothing to do if the frame is the same as the one on the screen
+	if (last == -1)
+		return;
+
+	// Upload only the rows that changed
+	SDL_Rect rect = { 0, first, width, last - first + 1 };
+	SDL_UpdateTexture(texture, &rect, &pixels[first*width],
+	                  width*sizeof(uint32_t));
+	//SDL_RenderClear(renderer);
+	SDL_RenderCopy(renderer, texture, NULL, NULL);
+	SDL_RenderPresent(renderer);
+}
+
+void SDLFrontend::set_sound(bool on){
+	wave.set_on(on);
+}
+
+void SDLFrontend::handle_event(const SDL_Event& e){
+	std::lock_guard<std::mutex> guard(input_lock);
+	if (e.type == SDL_QUIT)
+		commands |= CMD_QUIT; // exit
+
+	// Keep which keys are pressed and which aren't. The last event of each
+	// key wins
+	else if (e.type == SDL_KEYDOWN){
+		for (int i = 0; i < 16; i++){
+			if (e.key.keysym.sym == KEYMAP[i]){
+				keys_down |= 1 << i;
+				keys_up   &= ~(1 << i);
+			}
+		}
+
+		// Save state, load state, rewind and turbo hotkeys
+		SDL_Keycode sym = e.key.keysym.sym;
+		if (sym == REWIND_KEY)
+			rewinding = true;
+		if (sym == TURBO_KEY && !e.key.repeat)
+			commands |= CMD_TURBO;
+		if (sym >= SDLK_F1 && sym < SDLK_F1 + STATE_SLOTS){
+			commands |= CMD_SAVE_STATE;
+			command_slot = sym - SDLK_F1 + 1;
+		} else if (sym >= SDLK_F5 && sym < SDLK_F5 + STATE_SLOTS){
+			commands |= CMD_LOAD_STATE;
+			command_slot = sym - SDLK_F5 + 1;
+		}
+
+	} else if (e.type == SDL_KEYUP){
+		for (int i = 0; i < 16; i++){
+			if (e.key.keysym.sym == KEYMAP[i]){
+				keys_up   |= 1 << i;
+				keys_down &= ~(1 << i);
+			}
+		}
+		if (e.key.keysym.sym == REWIND_KEY)
+			rewinding = false;
+	} else
+		return;
+
+	new_input = true;
+	input_set.notify_one();
+}
+
+uint32_t SDLFrontend::update_keys(std::bitset<0x10>& keys){
+	std::lock_guard<std::mutex> guard(input_lock);
+	keys = (keys | std::bitset<0x10>(keys_down)) & ~std::bitset<0x10>(keys_up);
+	uint32_t result = commands;
+	if (rewinding)
+		result |= CMD_REWIND;
+	if (result & (CMD_SAVE_STATE | CMD_LOAD_STATE))
+		slot = command_slot;
+	keys_down = keys_up = 0;
+	commands  = CMD_NONE;
+	new_input = false;
+	return result;
+}
+
+void SDLFrontend::wait_input(int timeout_ms){
+	// Input is left for update_keys()
+	std::unique_lock<std::mutex> guard(input_lock);
+	auto pred = [this]{ return new_input; };
+	if (timeout_ms < 0)
+		input_set.wait(guard, pred);
+	else
+		input_set.wait_for(guard, std::chrono::milliseconds(timeout_ms), pred);
+}
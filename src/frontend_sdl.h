@@ -0,0 +1,118 @@
+#ifndef _FRONTEND_SDL_H
+#define _FRONTEND_SDL_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <SDL2/SDL.h>
+#include "frontend.h"
+#include "audio.h"
+#include "triple_buffer.h"
+#include "variant.h"
+
+// Frontend that displays the screen in a window, plays sound and reads input
+// using SDL. SDL wants the window, the renderer and the events to be used by
+// the thread that created them, so that thread runs loop(), and the emulator
+// runs in another thread, which never waits for the renderer:
+// update_screen() publishes the frame in a triple buffer, and loop()
+// presents the newest one, waiting for vsync. Input is passed the other way,
+// under a lock. The window has the same size for every screen resolution.
+class SDLFrontend : public Frontend {
+	public:
+		static const SDL_Keycode KEYMAP[0x10];
+
+		// Key that rewinds while it's held
+		static const SDL_Keycode REWIND_KEY = SDLK_BACKSPACE;
+
+		// Key that toggles turbo mode
+		static const SDL_Keycode TURBO_KEY = SDLK_TAB;
+
+		// Number of save state slots. Keys F1 to F4 save state to slots 1
+		// to 4, and keys F5 to F8 load state from them
+		static const int STATE_SLOTS = 4;
+
+		// Samples in each audio buffer. It's less than a frame, so sound
+		// changes are heard in the next frame at most
+		static const int AUDIO_SAMPLES = 512;
+
+		// Colors of the pixels, indexed by their bit of each plane
+		static const uint32_t PALETTE[4];
+
+	private:
+		// Largest framebuffer, the one of XO-CHIP
+		static const int MAX_W     = XoChip::SCREEN_W;
+		static const int MAX_H     = XoChip::SCREEN_H;
+		static const int MAX_WORDS = XoChip::PLANES*MAX_H*MAX_W/64;
+
+		struct Frame {
+			uint64_t words[MAX_WORDS];
+		};
+
+		SDL_Window*       window;
+		SDL_Renderer*     renderer;
+		SDL_Texture*      texture;
+
+		// Shape of the framebuffer, see Frontend::update_screen()
+		int               width;
+		int               height;
+		int               planes;
+		int               n_words;
+
+		// Frames from update_screen() to loop(), which is woken up by an
+		// event of type `wake_event` when there's a new frame
+		TripleBuffer<Frame> frames;
+		uint32_t          wake_event;
+		std::atomic<bool> stopped;
+
+		// Input from loop() not taken by update_keys() yet: keys pressed
+		// and released, commands, and the slot of the last state command.
+		// `input_set` is signaled when there's new input
+		std::mutex              input_lock;
+		std::condition_variable input_set;
+		bool                    new_input;
+		uint16_t                keys_down;
+		uint16_t                keys_up;
+		uint32_t                commands;
+		int                     command_slot;
+
+		// Is the rewind key held?
+		bool              rewinding;
+
+		// Framebuffer currently in the texture, and its pixels
+		uint64_t          shown[MAX_WORDS];
+		uint32_t          pixels[MAX_H*MAX_W];
+
+		// Buzzer, played by the audio callback
+		SquareWave        wave;
+		SDL_AudioDeviceID audio_dev;
+
+		// Record the input of the event `e`
+		void handle_event(const SDL_Event& e);
+
+		// Draw `framebuf` into the texture and present it
+		void draw(const uint64_t* framebuf);
+
+	public:
+		// Initialize SDL stuff and create a window for `game_name`, with a
+		// screen of `width` x `height` pixels and `planes` planes
+		SDLFrontend(const char* game_name, int width = FRAMEBUF_W,
+		            int height = FRAMEBUF_H, int planes = 1);
+
+		// Free SDL stuff
+		~SDLFrontend();
+
+		// Handle events and present the frames from update_screen() until
+		// stop() is called. It must be run by the thread that created the
+		// frontend
+		void loop();
+
+		// Make loop() return. It can be called from any thread
+		void stop();
+
+		void update_screen(const uint64_t* framebuf, uint64_t dirty_rows);
+		void set_sound(bool on);
+		uint32_t update_keys(std::bitset<0x10>& keys);
+		void wait_input(int timeout_ms);
+};
+
+#endif
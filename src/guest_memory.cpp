@@ -0,0 +1,79 @@
+#include <string.h>
+#include <algorithm>
+#include "guest_memory.h"
+
+template <class V>
+void BasicGuestMemory<V>::map(const uint8_t* image, const Inst* decoded){
+	for (uint i = 0; i < N_PAGES; i++){
+		pages[i]         = image + i*PAGE_SIZE;
+		this->decoded[i] = decoded + i*PAGE_SIZE;
+		owned[i].reset();
+	}
+}
+
+template <class V>
+void BasicGuestMemory<V>::copy_page(uint i){
+	owned[i].reset(new Page);
+	memcpy(owned[i]->memory, pages[i], PAGE_SIZE);
+	memcpy(owned[i]->decoded, decoded[i], sizeof(owned[i]->decoded));
+	pages[i]   = owned[i]->memory;
+	decoded[i] = owned[i]->decoded;
+}
+
+template <class V>
+void BasicGuestMemory<V>::read_pages(uint16_t addr, uint8_t* out, size_t len) const {
+	while (len > 0){
+		size_t n = std::min(len, PAGE_SIZE - (addr & PAGE_MASK));
+		memcpy(out, pages[addr >> PAGE_BITS] + (addr & PAGE_MASK), n);
+		addr += n;
+		out  += n;
+		len  -= n;
+	}
+}
+
+template <class V>
+bool BasicGuestMemory<V>::equal(uint16_t addr, const uint8_t* data, size_t len) const {
+	while (len > 0){
+		size_t n = std::min(len, PAGE_SIZE - (addr & PAGE_MASK));
+		if (memcmp(data, pages[addr >> PAGE_BITS] + (addr & PAGE_MASK), n))
+			return false;
+		addr += n;
+		data += n;
+		len  -= n;
+	}
+	return true;
+}
+
+template <class V>
+void BasicGuestMemory<V>::write(uint16_t addr, const uint8_t* data, size_t len){
+	// An instruction at `addr`-1 also reads the byte at `addr`, so its page
+	// is copied too
+	size_t start = (addr > 0 ? addr-1 : 0);
+	size_t end   = addr + len;
+
+	// Usually everything is in the same page
+	if (start >> PAGE_BITS == end >> PAGE_BITS){
+		own(start >> PAGE_BITS);
+		Page& page = *owned[start >> PAGE_BITS];
+		memcpy(&page.memory[addr & PAGE_MASK], data, len);
+		for (size_t a = start & PAGE_MASK; a < (end & PAGE_MASK); a++)
+			page.decoded[a] = V::decode((page.memory[a] << 8) | page.memory[a+1]);
+		return;
+	}
+
+	for (size_t i = start >> PAGE_BITS; i <= (end-1) >> PAGE_BITS; i++)
+		own(i);
+	for (size_t i = 0; i < len; i++)
+		owned[(addr+i) >> PAGE_BITS]->memory[(addr+i) & PAGE_MASK] = data[i];
+	uint8_t next = read(start);
+	for (size_t a = start; a < end; a++){
+		uint8_t byte = next;
+		next = (a+1 < SIZE ? read(a+1) : 0);
+		Inst* decoded = owned[a >> PAGE_BITS]->decoded;
+		decoded[a & PAGE_MASK] = V::decode((byte << 8) | next);
+	}
+}
+
+template class BasicGuestMemory<Chip8>;
+template class BasicGuestMemory<SuperChip>;
+template class BasicGuestMemory<XoChip>;
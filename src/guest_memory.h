@@ -0,0 +1,98 @@
+#ifndef _GUEST_MEMORY_H
+#define _GUEST_MEMORY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <sys/types.h>
+#include "inst.h"
+#include "variant.h"
+
+// CHIP-8 memory of an emulator, with the decoded instruction at each address.
+// It's split in pages that point to the memory image of the ROM, which is
+// shared by every emulator running it, until they are written: then they are
+// copied, and only that copy is written. Most programs only write a few bytes
+// of variables and scores with Fx33 and Fx55, so an emulator usually owns one
+// or two pages instead of the whole memory.
+//
+// Reads are a page table lookup. Accesses of more than one byte that cross
+// pages take a slower path. Its size and how instructions are decoded depend
+// on the variant `V`.
+template <class V>
+class BasicGuestMemory {
+	public:
+		static const size_t   SIZE      = V::MEMORY_SIZE;
+		static const uint     PAGE_BITS = 8;
+		static const size_t   PAGE_SIZE = 1 << PAGE_BITS;
+		static const uint16_t PAGE_MASK = PAGE_SIZE - 1;
+		static const size_t   N_PAGES   = SIZE / PAGE_SIZE;
+
+		// Point every page to `image`, of SIZE bytes, and to `decoded`, its
+		// decoded instructions. Both must outlive this
+		void map(const uint8_t* image, const Inst* decoded);
+
+		// Byte at `addr`
+		uint8_t read(uint16_t addr) const {
+			return pages[addr >> PAGE_BITS][addr & PAGE_MASK];
+		}
+
+		// Decoded instruction at `addr`
+		const Inst& fetch(uint16_t addr) const {
+			return decoded[addr >> PAGE_BITS][addr & PAGE_MASK];
+		}
+
+		// Copy `len` bytes at `addr` into `out`. They must be inside memory
+		void read(uint16_t addr, uint8_t* out, size_t len) const {
+			if ((addr & PAGE_MASK) + len <= PAGE_SIZE)
+				memcpy(out, pages[addr >> PAGE_BITS] + (addr & PAGE_MASK), len);
+			else
+				read_pages(addr, out, len);
+		}
+
+		// Get `len` bytes at `addr`, which must be inside memory. They are
+		// only copied into `buf` if they cross pages
+		const uint8_t* view(uint16_t addr, uint8_t* buf, size_t len) const {
+			if ((addr & PAGE_MASK) + len <= PAGE_SIZE)
+				return pages[addr >> PAGE_BITS] + (addr & PAGE_MASK);
+			read_pages(addr, buf, len);
+			return buf;
+		}
+
+		// Write `len` bytes of `data` at `addr` and decode the instructions
+		// affected, copying the pages that are shared. They must be inside
+		// memory
+		void write(uint16_t addr, const uint8_t* data, size_t len);
+
+		// Are the `len` bytes at `addr` equal to `data`?
+		bool equal(uint16_t addr, const uint8_t* data, size_t len) const;
+
+	private:
+		struct Page {
+			uint8_t memory[PAGE_SIZE];
+			Inst    decoded[PAGE_SIZE];
+		};
+
+		const uint8_t* pages[N_PAGES];
+		const Inst*    decoded[N_PAGES];
+
+		// Copies of the pages that were written, or NULL
+		std::unique_ptr<Page> owned[N_PAGES];
+
+		// Make sure page `i` is a copy, copying it if it's shared
+		void own(uint i){
+			if (!owned[i])
+				copy_page(i);
+		}
+		void copy_page(uint i);
+
+		// read() across pages
+		void read_pages(uint16_t addr, uint8_t* out, size_t len) const;
+
+		// Translated code reads through the page table
+		friend class Jit;
+};
+
+typedef BasicGuestMemory<Chip8> GuestMemory;
+
+#endif
@@ -0,0 +1,232 @@
+#include <string.h>
+#include <sys/types.h>
+#include "inst.h"
+
+Inst decode_inst(uint16_t inst){
+	uint8_t opcode = (inst & 0xF000) >> 12;
+
+	// Auxiliary values
+	uint16_t nnn = inst & 0x0FFF;
+	uint8_t  n   = inst & 0x000F;
+	uint8_t  kk  = inst & 0x00FF;
+	uint8_t  x   = (inst & 0x0F00) >> 8;
+	uint8_t  y   = (inst & 0x00F0) >> 4;
+
+	Inst result = { OP_UNKNOWN, 0, 0, 0, inst };
+	switch (opcode){
+		case 0x0:
+			if (inst == 0x00E0)
+				result = { OP_CLS, 0, 0, 0, 0 };
+			else if (inst == 0x00EE)
+				result = { OP_RET, 0, 0, 0, 0 };
+			break;
+
+		case 0x1: result = { OP_JP,       0, 0, 0,  nnn }; break;
+		case 0x2: result = { OP_CALL,     0, 0, 0,  nnn }; break;
+		case 0x3: result = { OP_SE_BYTE,  x, 0, kk, 0   }; break;
+		case 0x4: result = { OP_SNE_BYTE, x, 0, kk, 0   }; break;
+		case 0x5: result = { OP_SE_REG,   x, y, 0,  0   }; break;
+		case 0x6: result = { OP_LD_BYTE,  x, 0, kk, 0   }; break;
+		case 0x7: result = { OP_ADD_BYTE, x, 0, kk, 0   }; break;
+
+		case 0x8:
+			switch (n){
+				case 0x0: result = { OP_LD_REG,  x, y, 0, 0 }; break;
+				case 0x1: result = { OP_OR,      x, y, 0, 0 }; break;
+				case 0x2: result = { OP_AND,     x, y, 0, 0 }; break;
+				case 0x3: result = { OP_XOR,     x, y, 0, 0 }; break;
+				case 0x4: result = { OP_ADD_REG, x, y, 0, 0 }; break;
+				case 0x5: result = { OP_SUB,     x, y, 0, 0 }; break;
+				case 0x6: result = { OP_SHR,     x, y, 0, 0 }; break;
+				case 0x7: result = { OP_SUBN,    x, y, 0, 0 }; break;
+				case 0xE: result = { OP_SHL,     x, y, 0, 0 }; break;
+			}
+			break;
+
+		case 0x9: result = { OP_SNE_REG, x, y, 0,  0   }; break;
+		case 0xA: result = { OP_LD_I,    0, 0, 0,  nnn }; break;
+		case 0xB: result = { OP_JP_V0,   0, 0, 0,  nnn }; break;
+		case 0xC: result = { OP_RND,     x, 0, kk, 0   }; break;
+		case 0xD: result = { OP_DRW,     x, y, n,  0   }; break;
+
+		case 0xE:
+			if (kk == 0x9E)
+				result = { OP_SKP, x, 0, 0, 0 };
+			else if (kk == 0xA1)
+				result = { OP_SKNP, x, 0, 0, 0 };
+			break;
+
+		case 0xF:
+			switch (kk){
+				case 0x07: result = { OP_LD_VX_DT,  x, 0, 0, 0 }; break;
+				case 0x0A: result = { OP_LD_VX_K,   x, 0, 0, 0 }; break;
+				case 0x15: result = { OP_LD_DT_VX,  x, 0, 0, 0 }; break;
+				case 0x18: result = { OP_LD_ST_VX,  x, 0, 0, 0 }; break;
+				case 0x1E: result = { OP_ADD_I,     x, 0, 0, 0 }; break;
+				case 0x29: result = { OP_LD_F,      x, 0, 0, 0 }; break;
+				case 0x33: result = { OP_LD_B,      x, 0, 0, 0 }; break;
+				case 0x55: result = { OP_LD_MEM_VX, x, 0, 0, 0 }; break;
+				case 0x65: result = { OP_LD_VX_MEM, x, 0, 0, 0 }; break;
+			}
+			break;
+	}
+	return result;
+}
+
+Inst decode_inst(uint16_t inst, uint32_t extensions){
+	uint8_t n  = inst & 0x000F;
+	uint8_t kk = inst & 0x00FF;
+	uint8_t x  = (inst & 0x0F00) >> 8;
+	uint8_t y  = (inst & 0x00F0) >> 4;
+	bool schip = extensions & EXT_SCHIP;
+	bool xo    = extensions & EXT_XO;
+
+	// CHIP-8 ignores the last nibble of 5xy0, so it would take these
+	if (xo && (inst & 0xF00F) == 0x5002)
+		return { OP_SAVE, x, y, 0, 0 };
+	if (xo && (inst & 0xF00F) == 0x5003)
+		return { OP_LOAD, x, y, 0, 0 };
+
+	// Extensions only add instructions
+	Inst result = decode_inst(inst);
+	if (result.op != OP_UNKNOWN)
+		return result;
+	switch (inst >> 12){
+		case 0x0:
+			if (schip && (inst & 0xFFF0) == 0x00C0)
+				result = { OP_SCD, 0, 0, n, 0 };
+			else if (xo && (inst & 0xFFF0) == 0x00D0)
+				result = { OP_SCU, 0, 0, n, 0 };
+			else if (schip && inst == 0x00FB)
+				result = { OP_SCR, 0, 0, 0, 0 };
+			else if (schip && inst == 0x00FC)
+				result = { OP_SCL, 0, 0, 0, 0 };
+			else if (schip && inst == 0x00FD)
+				result = { OP_EXIT, 0, 0, 0, 0 };
+			else if (schip && inst == 0x00FE)
+				result = { OP_LOW, 0, 0, 0, 0 };
+			else if (schip && inst == 0x00FF)
+				result = { OP_HIGH, 0, 0, 0, 0 };
+			break;
+
+		case 0xF:
+			if (xo && inst == 0xF000)
+				result = { OP_LD_I_LONG, 0, 0, 0, 0 };
+			else if (xo && inst == 0xF002)
+				result = { OP_AUDIO, 0, 0, 0, 0 };
+			else if (xo && kk == 0x01)
+				result = { OP_PLANE, x, 0, 0, 0 };
+			else if (xo && kk == 0x3A)
+				result = { OP_PITCH, x, 0, 0, 0 };
+			else if (schip && kk == 0x30)
+				result = { OP_LD_HF, x, 0, 0, 0 };
+			else if (schip && kk == 0x75)
+				result = { OP_LD_R_VX, x, 0, 0, 0 };
+			else if (schip && kk == 0x85)
+				result = { OP_LD_VX_R, x, 0, 0, 0 };
+			break;
+	}
+	return result;
+}
+
+const char* op_name(Op op){
+	static const char* const names[] = {
+		"00E0 CLS",           "00EE RET",           "1nnn JP addr",
+		"2nnn CALL addr",     "3xkk SE Vx, byte",   "4xkk SNE Vx, byte",
+		"5xy0 SE Vx, Vy",     "6xkk LD Vx, byte",   "7xkk ADD Vx, byte",
+		"8xy0 LD Vx, Vy",     "8xy1 OR Vx, Vy",     "8xy2 AND Vx, Vy",
+		"8xy3 XOR Vx, Vy",    "8xy4 ADD Vx, Vy",    "8xy5 SUB Vx, Vy",
+		"8xy6 SHR Vx",        "8xy7 SUBN Vx, Vy",   "8xyE SHL Vx",
+		"9xy0 SNE Vx, Vy",    "Annn LD I, addr",    "Bnnn JP V0, addr",
+		"Cxkk RND Vx, byte",  "Dxyn DRW Vx, Vy, n", "Ex9E SKP Vx",
+		"ExA1 SKNP Vx",       "Fx07 LD Vx, DT",     "Fx0A LD Vx, K",
+		"Fx15 LD DT, Vx",     "Fx18 LD ST, Vx",     "Fx1E ADD I, Vx",
+		"Fx29 LD F, Vx",      "Fx33 LD B, Vx",      "Fx55 LD [I], Vx",
+		"Fx65 LD Vx, [I]",    "00Cn SCD n",         "00FB SCR",
+		"00FC SCL",           "00FD EXIT",          "00FE LOW",
+		"00FF HIGH",          "Fx30 LD HF, Vx",     "Fx75 LD R, Vx",
+		"Fx85 LD Vx, R",      "00Dn SCU n",         "5xy2 SAVE Vx, Vy",
+		"5xy3 LOAD Vx, Vy",   "F000 LD I, long",    "Fn01 PLANE n",
+		"F002 AUDIO",         "Fx3A PITCH Vx",      "unknown"
+	};
+	static_assert(sizeof(names)/sizeof(names[0]) == OP_COUNT, "missing names");
+	return (op < OP_COUNT ? names[op] : "invalid");
+}
+
+// Assembly of each operation, in the order of `Op`. Operands are written
+// where there's a `%`: `%x` and `%y` are register numbers in decimal, `%k`,
+// `%n` and `%a` are kk, n and nnn in hex, and `%g` and `%r` are the first
+// digit and the whole raw instruction in hex, for unknown ones
+static const char* const formats[] = {
+	"cls",                "ret",                "jp    0x%a",
+	"call  0x%a",         "se    V%x, 0x%k",    "sne   V%x, 0x%k",
+	"se    V%x, V%y",     "ld    V%x, 0x%k",    "add   V%x, 0x%k",
+	"ld    V%x, V%y",     "or    V%x, V%y",     "and   V%x, V%y",
+	"xor   V%x, V%y",     "add   V%x, V%y",     "sub   V%x, V%y",
+	"shr   V%x {, V%y}",  "subn  V%x, V%y",     "shl   V%x {, V%y}",
+	"sne   V%x, V%y",     "ld    I, 0x%a",      "jp    V0, 0x%a",
+	"rnd   V%x, 0x%k",    "drw   V%x, V%y, 0x%n", "skp   V%x",
+	"sknp  V%x",          "ld    V%x, DT",      "ld    V%x, K",
+	"ld    DT, V%x",      "ld    ST, V%x",      "add   I, V%x",
+	"ld    F, V%x",       "ld    B, V%x",       "ld    [I], V%x",
+	"ld    V%x, [I]",     "scd   0x%n",         "scr",
+	"scl",                "exit",               "low",
+	"high",               "ld    HF, V%x",      "ld    R, V%x",
+	"ld    V%x, R",       "scu   0x%n",         "save  V%x, V%y",
+	"load  V%x, V%y",     "ld    I, long",      "plane %x",
+	"audio",              "pitch V%x",          "Unknown inst %g: 0x%r"
+};
+static_assert(sizeof(formats)/sizeof(formats[0]) == OP_COUNT,
+              "missing formats");
+
+// Write `value` in decimal or in hex without leading zeros
+static char* put_dec(char* out, uint value){
+	if (value >= 10)
+		*out++ = '0' + value/10;
+	*out++ = '0' + value%10;
+	return out;
+}
+
+static char* put_hex(char* out, uint value){
+	static const char digits[] = "0123456789ABCDEF";
+	int shift = 12;
+	while (shift > 0 && !(value >> shift))
+		shift -= 4;
+	for (; shift >= 0; shift -= 4)
+		*out++ = digits[(value >> shift) & 0xF];
+	return out;
+}
+
+char* format_inst(uint16_t inst, char* out, uint32_t extensions){
+	// Operands are decoded here because decode_inst() zeroes the ones the
+	// operation doesn't use, but shr and shl show Vy anyway
+	uint8_t x = (inst & 0x0F00) >> 8;
+	uint8_t y = (inst & 0x00F0) >> 4;
+	Op op = (extensions ? decode_inst(inst, extensions) : decode_inst(inst)).op;
+	for (const char* p = formats[op]; *p; p++){
+		if (*p != '%'){
+			*out++ = *p;
+			continue;
+		}
+		switch (*++p){
+			case 'x': out = put_dec(out, x); break;
+			case 'y': out = put_dec(out, y); break;
+			case 'k': out = put_hex(out, inst & 0x00FF); break;
+			case 'n': out = put_hex(out, inst & 0x000F); break;
+			case 'a': out = put_hex(out, inst & 0x0FFF); break;
+			case 'g': out = put_hex(out, inst >> 12); break;
+			case 'r': out = put_hex(out, inst); break;
+		}
+	}
+	return out;
+}
+
+void disass_inst(uint16_t inst, char* buf, size_t size, uint32_t extensions){
+	char text[DISASS_MAX];
+	size_t len = format_inst(inst, text, extensions) - text;
+	if (size == 0)
+		return;
+	len = (len < size-1 ? len : size-1);
+	memcpy(buf, text, len);
+	buf[len] = 0;
+}
@@ -0,0 +1,108 @@
+#ifndef _INST_H
+#define _INST_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Operation of a decoded instruction. There's one for each CHIP-8
+// instruction, then the SUPER-CHIP and XO-CHIP ones, plus OP_UNKNOWN for
+// invalid ones.
+enum Op : uint8_t {
+	OP_CLS,       // 00E0
+	OP_RET,       // 00EE
+	OP_JP,        // 1nnn
+	OP_CALL,      // 2nnn
+	OP_SE_BYTE,   // 3xkk
+	OP_SNE_BYTE,  // 4xkk
+	OP_SE_REG,    // 5xy0
+	OP_LD_BYTE,   // 6xkk
+	OP_ADD_BYTE,  // 7xkk
+	OP_LD_REG,    // 8xy0
+	OP_OR,        // 8xy1
+	OP_AND,       // 8xy2
+	OP_XOR,       // 8xy3
+	OP_ADD_REG,   // 8xy4
+	OP_SUB,       // 8xy5
+	OP_SHR,       // 8xy6
+	OP_SUBN,      // 8xy7
+	OP_SHL,       // 8xyE
+	OP_SNE_REG,   // 9xy0
+	OP_LD_I,      // Annn
+	OP_JP_V0,     // Bnnn
+	OP_RND,       // Cxkk
+	OP_DRW,       // Dxyn
+	OP_SKP,       // Ex9E
+	OP_SKNP,      // ExA1
+	OP_LD_VX_DT,  // Fx07
+	OP_LD_VX_K,   // Fx0A
+	OP_LD_DT_VX,  // Fx15
+	OP_LD_ST_VX,  // Fx18
+	OP_ADD_I,     // Fx1E
+	OP_LD_F,      // Fx29
+	OP_LD_B,      // Fx33
+	OP_LD_MEM_VX, // Fx55
+	OP_LD_VX_MEM, // Fx65
+
+	// SUPER-CHIP
+	OP_SCD,       // 00Cn
+	OP_SCR,       // 00FB
+	OP_SCL,       // 00FC
+	OP_EXIT,      // 00FD
+	OP_LOW,       // 00FE
+	OP_HIGH,      // 00FF
+	OP_LD_HF,     // Fx30
+	OP_LD_R_VX,   // Fx75
+	OP_LD_VX_R,   // Fx85
+
+	// XO-CHIP
+	OP_SCU,       // 00Dn
+	OP_SAVE,      // 5xy2
+	OP_LOAD,      // 5xy3
+	OP_LD_I_LONG, // F000 nnnn
+	OP_PLANE,     // Fn01
+	OP_AUDIO,     // F002
+	OP_PITCH,     // Fx3A
+
+	OP_UNKNOWN,
+	OP_COUNT
+};
+
+// Decoded instruction. Operands that the operation doesn't use are zero,
+// except for OP_UNKNOWN, which keeps the raw instruction in `nnn`.
+struct Inst {
+	Op       op;
+	uint8_t  x;
+	uint8_t  y;
+	uint8_t  kk; // Also used for `n`
+	uint16_t nnn;
+};
+
+// Instruction set extensions
+const uint32_t EXT_SCHIP = 1 << 0;
+const uint32_t EXT_XO    = 1 << 1;
+
+// Decode the raw CHIP-8 instruction `inst`
+Inst decode_inst(uint16_t inst);
+
+// Decode the raw instruction `inst` with the `extensions`. The n of 00Cn and
+// 00Dn is kept in `kk`, and the one of Fn01 in `x`. F000 is the first half of
+// a 4 byte instruction: the address is the next word, read when it's run
+Inst decode_inst(uint16_t inst, uint32_t extensions);
+
+// Name of `op`, with its encoding, such as "Dxyn DRW Vx, Vy, n"
+const char* op_name(Op op);
+
+// Maximum length of the assembly of an instruction
+const size_t DISASS_MAX = 32;
+
+// Write the assembly of the raw instruction `inst` at `out`, such as
+// "drw   V0, V1, 0x5", decoded with `extensions`. It takes at most
+// DISASS_MAX bytes, and it isn't null terminated. Returns the end of the text
+char* format_inst(uint16_t inst, char* out, uint32_t extensions = 0);
+
+// Same as format_inst(), into the null terminated string `buf` of `size`
+// bytes
+void disass_inst(uint16_t inst, char* buf, size_t size,
+                 uint32_t extensions = 0);
+
+#endif
@@ -0,0 +1,679 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include "jit.h"
+#include "emulator.h"
+#include "cfg.h"
+
+#if defined(__x86_64__)
+
+// Small x86-64 assembler. It only knows the instructions the JIT uses. Memory
+// operands are always [rbx + disp32], that is, a field of the emulator.
+class Asm {
+	public:
+		uint8_t* p;
+
+		Asm(uint8_t* p) : p(p) {}
+
+		void byte(uint8_t b){ *p++ = b; }
+		void word(uint16_t w){ memcpy(p, &w, 2); p += 2; }
+		void dword(uint32_t d){ memcpy(p, &d, 4); p += 4; }
+		void qword(uint64_t q){ memcpy(p, &q, 8); p += 8; }
+
+		// ModRM for [rbx + disp32] with `reg` as the register operand
+		void mem(uint8_t reg, int32_t disp){
+			byte(0x80 | (reg << 3) | 3);
+			dword(disp);
+		}
+
+		// Emit a rel32 to `target`, computed from the end of the instruction
+		void rel32(uint8_t* target){
+			dword(target - (p + 4));
+		}
+
+		void mov_al_mem(int32_t d)  { byte(0x8A); mem(0, d); }
+		void mov_mem_al(int32_t d)  { byte(0x88); mem(0, d); }
+		void mov_mem_cl(int32_t d)  { byte(0x88); mem(1, d); }
+		void movzx_eax_mem8(int32_t d){ byte(0x0F); byte(0xB6); mem(0, d); }
+
+		// `op` al, [mem]
+		void alu_al_mem(uint8_t op, int32_t d){ byte(op); mem(0, d); }
+
+		// `op` [mem], al
+		void alu_mem_al(uint8_t op, int32_t d){ byte(op); mem(0, d); }
+
+		// `op` byte [mem], imm8
+		void alu_mem_imm8(uint8_t op, uint8_t ext, int32_t d, uint8_t imm){
+			byte(op); mem(ext, d); byte(imm);
+		}
+
+		// setcc cl
+		void setcc_cl(uint8_t cc){ byte(0x0F); byte(0x90 | cc); byte(0xC1); }
+
+		// jcc rel32, returns the address of the rel32 to patch it later
+		uint8_t* jcc(uint8_t cc, uint8_t* target){
+			byte(0x0F); byte(0x80 | cc);
+			uint8_t* site = p;
+			rel32(target);
+			return site;
+		}
+
+		// jmp rel32, returns the address of the rel32 to patch it later
+		uint8_t* jmp(uint8_t* target){
+			byte(0xE9);
+			uint8_t* site = p;
+			rel32(target);
+			return site;
+		}
+};
+
+// Condition codes
+enum {
+	CC_B  = 0x2,
+	CC_AE = 0x3,
+	CC_E  = 0x4,
+	CC_NE = 0x5,
+	CC_BE = 0x6,
+	CC_A  = 0x7,
+};
+
+bool Jit::supported(){
+	return true;
+}
+
+Jit* Jit::create(Emulator& emu){
+	uint8_t* code = (uint8_t*)mmap(NULL, CODE_SIZE, PROT_READ|PROT_WRITE,
+	                               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		return NULL;
+
+	// Some hosts don't allow anonymous memory to become executable
+	if (mprotect(code, CODE_SIZE, PROT_READ|PROT_EXEC) ||
+	    mprotect(code, CODE_SIZE, PROT_READ|PROT_WRITE)){
+		munmap(code, CODE_SIZE);
+		return NULL;
+	}
+	return new Jit(emu, code);
+}
+
+Jit::Jit(Emulator& emu, uint8_t* code) : emu(emu), code(code), writable(true) {
+	code_end = code + CODE_SIZE;
+
+	uint8_t* base = (uint8_t*)&emu;
+	off_regs  = (uint8_t*)&emu.regs        - base;
+	off_I     = (uint8_t*)&emu.I           - base;
+	off_pc    = (uint8_t*)&emu.pc          - base;
+	off_sp    = (uint8_t*)&emu.sp          - base;
+	off_stack = (uint8_t*)&emu.stack       - base;
+	off_dt    = (uint8_t*)&emu.delay_timer - base;
+	off_st    = (uint8_t*)&emu.sound_timer - base;
+	off_pages = (uint8_t*)&emu.memory.pages - base;
+
+	emit_routines();
+	flush();
+}
+
+Jit::~Jit(){
+	munmap(code, CODE_SIZE);
+}
+
+bool Jit::protect(bool writable){
+	if (writable == this->writable)
+		return true;
+	int prot = (writable ? PROT_READ|PROT_WRITE : PROT_READ|PROT_EXEC);
+	if (mprotect(code, CODE_SIZE, prot))
+		return false;
+	this->writable = writable;
+	return true;
+}
+
+void Jit::emit_routines(){
+	Asm a(code);
+
+	// Enter: rdi = emu, rsi = code, rdx = budget, rcx = blocks table
+	enter = (EnterFunc)a.p;
+	a.byte(0x53);                                  // push rbx
+	a.byte(0x41); a.byte(0x54);                    // push r12
+	a.byte(0x41); a.byte(0x55);                    // push r13
+	a.byte(0x41); a.byte(0x56);                    // push r14
+	a.byte(0x41); a.byte(0x57);                    // push r15
+	a.byte(0x48); a.byte(0x89); a.byte(0xFB);      // mov rbx, rdi
+	a.byte(0x49); a.byte(0x89); a.byte(0xD7);      // mov r15, rdx
+	a.byte(0x49); a.byte(0x89); a.byte(0xCE);      // mov r14, rcx
+	a.byte(0x44); a.byte(0x8B); a.byte(0x2A);      // mov r13d, [rdx]
+	a.byte(0x44); a.byte(0x0F); a.byte(0xB7);      // movzx r12d, word [I]
+	a.mem(4, off_I);
+	a.byte(0xFF); a.byte(0xE6);                    // jmp rsi
+
+	// Exit without link: rax = NULL
+	exit_nolink = a.p;
+	a.byte(0x31); a.byte(0xC0);                    // xor eax, eax
+
+	// Exit: write back I and budget and return rax
+	exit_link = a.p;
+	a.byte(0x66); a.byte(0x44); a.byte(0x89);      // mov [I], r12w
+	a.mem(4, off_I);
+	a.byte(0x45); a.byte(0x89); a.byte(0x2F);      // mov [r15], r13d
+	a.byte(0x41); a.byte(0x5F);                    // pop r15
+	a.byte(0x41); a.byte(0x5E);                    // pop r14
+	a.byte(0x41); a.byte(0x5D);                    // pop r13
+	a.byte(0x41); a.byte(0x5C);                    // pop r12
+	a.byte(0x5B);                                  // pop rbx
+	a.byte(0xC3);                                  // ret
+
+	code_blocks_start = a.p;
+}
+
+void Jit::flush(){
+	code_cur = code_blocks_start;
+	memset(blocks, 0, sizeof(blocks));
+	memset(interp_only, 0, sizeof(interp_only));
+	memset(block_size, 0, sizeof(block_size));
+	memset(code_refs, 0, sizeof(code_refs));
+	chains.clear();
+}
+
+void Jit::invalidate(uint16_t start, uint16_t end){
+	// Most writes don't hit translated code
+	const uint mem_size = GuestMemory::SIZE;
+	bool hit = false;
+	for (uint addr = start; addr < end && addr < mem_size && !hit; addr++)
+		hit = code_refs[addr];
+
+	// Only blocks starting less than a block before `start` can overlap it
+	if (hit){
+		uint first = (start > MAX_BLOCK_INST*2 ? start - MAX_BLOCK_INST*2 : 0);
+		for (uint pc = first; pc < end && pc < mem_size; pc++){
+			if (blocks[pc] && pc + block_size[pc] > start)
+				drop_block(pc);
+		}
+	}
+
+	// Instructions that read the written memory may be translatable now
+	for (uint pc = (start > 0 ? start-1 : 0); pc < end && pc < mem_size; pc++)
+		interp_only[pc] = false;
+}
+
+void Jit::drop_block(uint16_t pc){
+	// If the exits can't be unlinked, throw away everything so nothing
+	// jumps to the block anymore
+	if (!protect(true)){
+		flush();
+		return;
+	}
+	for (size_t i = 0; i < chains.size(); ){
+		if (chains[i].target == pc){
+			link(chains[i].site, chains[i].stub);
+			chains[i] = chains.back();
+			chains.pop_back();
+		} else
+			i++;
+	}
+	for (uint addr = pc; addr < pc + block_size[pc]; addr++)
+		code_refs[addr]--;
+	blocks[pc] = NULL;
+	block_size[pc] = 0;
+}
+
+// Returns whether the JIT can translate `op`, and whether `op` ends a block
+static bool translatable(Op op, bool& ends_block){
+	ends_block = false;
+	switch (op){
+		case OP_JP: case OP_CALL: case OP_RET: case OP_JP_V0:
+		case OP_SE_BYTE: case OP_SNE_BYTE: case OP_SE_REG: case OP_SNE_REG:
+			ends_block = true;
+			return true;
+
+		case OP_LD_BYTE: case OP_ADD_BYTE: case OP_LD_REG: case OP_OR:
+		case OP_AND: case OP_XOR: case OP_ADD_REG: case OP_SUB: case OP_SHR:
+		case OP_SUBN: case OP_SHL: case OP_LD_I: case OP_ADD_I: case OP_LD_F:
+		case OP_LD_VX_DT: case OP_LD_DT_VX: case OP_LD_ST_VX:
+		case OP_LD_VX_MEM:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// Bytes taken by an exit site (jcc or jmp) and the stub it jumps to
+static const size_t STATIC_EXIT_SIZE = 6 + 24; // mov [pc], mov rax, jmp
+static const size_t SIDE_EXIT_SIZE   = 6 + 18; // add r13d, mov [pc], jmp
+
+// Upper bound of the code emitted for `inst`, including its exits and their
+// stubs. Besides them, an instruction takes less than 64 bytes, except for
+// the loads of Fx65 and the dynamic exit of 00EE
+static size_t max_code_size(const Inst& inst){
+	switch (inst.op){
+		case OP_JP:
+			return STATIC_EXIT_SIZE;
+
+		case OP_CALL:
+			return 64 + SIDE_EXIT_SIZE + STATIC_EXIT_SIZE;
+
+		case OP_RET:
+			return 128 + SIDE_EXIT_SIZE;
+
+		case OP_SE_BYTE: case OP_SNE_BYTE: case OP_SE_REG: case OP_SNE_REG:
+			return 64 + 2*STATIC_EXIT_SIZE;
+
+		case OP_LD_F:
+			return 64 + SIDE_EXIT_SIZE;
+
+		case OP_LD_VX_MEM:
+			// A 4 byte load and a 6 byte store per register
+			return 64 + (inst.x+1)*10 + 2*SIDE_EXIT_SIZE;
+
+		default:
+			return 64;
+	}
+}
+
+uint8_t* Jit::compile(uint16_t pc){
+	// Find the instructions of the block
+	const uint16_t mem_size = GuestMemory::SIZE;
+	bool ends_block = false;
+	int n_inst = 0;
+	uint16_t addr = pc;
+
+	// Budget check at the start, and the exit to the next block at the end
+	size_t max_size = 16 + SIDE_EXIT_SIZE + STATIC_EXIT_SIZE;
+	while (addr < mem_size-1 && n_inst < MAX_BLOCK_INST){
+		const Inst& inst = emu.memory.fetch(addr);
+		if (!translatable(inst.op, ends_block))
+			break;
+		max_size += max_code_size(inst);
+		n_inst++;
+		addr += 2;
+		if (ends_block)
+			break;
+	}
+	if (n_inst == 0 || !protect(true))
+		return NULL;
+	uint16_t end = addr; // Address after the last instruction
+
+	// Make sure there's enough space
+	if (max_size > (size_t)(code_end - code_cur))
+		flush();
+
+	// Side exits to emit at the end of the block, when the instruction at
+	// `pc` can't be run by translated code and `budget` instructions must be
+	// given back
+	struct SideExit {
+		uint8_t* site;
+		uint16_t pc;
+		uint8_t  budget;
+	};
+	std::vector<SideExit> side_exits;
+
+	// Static exits to emit at the end of the block
+	struct StaticExit {
+		uint8_t* site;
+		uint16_t target;
+	};
+	std::vector<StaticExit> static_exits;
+
+	uint8_t* block = code_cur;
+	Asm a(code_cur);
+	const int32_t VF = off_regs + 0xF;
+
+	// Check budget, and subtract the instructions of the block
+	a.byte(0x41); a.byte(0x83); a.byte(0xFD); a.byte(n_inst); // cmp r13d, n
+	side_exits.push_back({a.jcc(CC_B, a.p), pc, 0});
+	a.byte(0x41); a.byte(0x83); a.byte(0xED); a.byte(n_inst); // sub r13d, n
+
+	// Dynamic exit with target in ecx: write pc and jump to the block in the
+	// table if there's one, or exit to C++
+	auto dynamic_exit = [&](){
+		a.byte(0x66); a.byte(0x89); a.mem(1, off_pc);    // mov [pc], cx
+		a.byte(0x81); a.byte(0xF9); a.dword(mem_size-2); // cmp ecx, size-2
+		a.jcc(CC_A, exit_nolink);
+		a.byte(0x49); a.byte(0x8B); a.byte(0x04); a.byte(0xCE); // mov rax, [r14+rcx*8]
+		a.byte(0x48); a.byte(0x85); a.byte(0xC0);        // test rax, rax
+		a.jcc(CC_E, exit_nolink);
+		a.byte(0xFF); a.byte(0xE0);                      // jmp rax
+	};
+
+	for (int i = 0; i < n_inst; i++){
+		uint16_t inst_pc = pc + i*2;
+		const Inst& inst = emu.memory.fetch(inst_pc);
+		int32_t VX = off_regs + inst.x;
+		int32_t VY = off_regs + inst.y;
+		uint8_t give_back = n_inst - i;
+
+		switch (inst.op){
+			case OP_LD_BYTE:
+				a.alu_mem_imm8(0xC6, 0, VX, inst.kk); // mov [Vx], kk
+				break;
+
+			case OP_ADD_BYTE:
+				a.alu_mem_imm8(0x80, 0, VX, inst.kk); // add [Vx], kk
+				break;
+
+			case OP_LD_REG:
+				a.mov_al_mem(VY);
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_OR:
+				a.mov_al_mem(VY);
+				a.alu_mem_al(0x08, VX); // or [Vx], al
+				break;
+
+			case OP_AND:
+				a.mov_al_mem(VY);
+				a.alu_mem_al(0x20, VX); // and [Vx], al
+				break;
+
+			case OP_XOR:
+				a.mov_al_mem(VY);
+				a.alu_mem_al(0x30, VX); // xor [Vx], al
+				break;
+
+			// For the instructions that set VF, VF is written first and then
+			// Vx and Vy are read again, as the interpreter does. This matters
+			// when x or y is F.
+			case OP_ADD_REG:
+				a.mov_al_mem(VX);
+				a.alu_al_mem(0x02, VY); // add al, [Vy]
+				a.setcc_cl(CC_B);
+				a.mov_mem_cl(VF);
+				a.mov_al_mem(VX);
+				a.alu_al_mem(0x02, VY);
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_SUB:
+				a.mov_al_mem(VX);
+				a.alu_al_mem(0x3A, VY); // cmp al, [Vy]
+				a.setcc_cl(CC_AE);
+				a.mov_mem_cl(VF);
+				a.mov_al_mem(VX);
+				a.alu_al_mem(0x2A, VY); // sub al, [Vy]
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_SHR:
+				a.mov_al_mem(VX);
+				a.byte(0x88); a.byte(0xC1);             // mov cl, al
+				a.byte(0x80); a.byte(0xE1); a.byte(1);  // and cl, 1
+				a.mov_mem_cl(VF);
+				a.mov_al_mem(VX);
+				a.byte(0xD0); a.byte(0xE8);             // shr al, 1
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_SUBN:
+				a.mov_al_mem(VY);
+				a.alu_al_mem(0x3A, VX); // cmp al, [Vx]
+				a.setcc_cl(CC_AE);
+				a.mov_mem_cl(VF);
+				a.mov_al_mem(VY);
+				a.alu_al_mem(0x2A, VX); // sub al, [Vx]
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_SHL:
+				a.mov_al_mem(VX);
+				a.byte(0x88); a.byte(0xC1);             // mov cl, al
+				a.byte(0xC0); a.byte(0xE9); a.byte(7);  // shr cl, 7
+				a.mov_mem_cl(VF);
+				a.mov_al_mem(VX);
+				a.byte(0x00); a.byte(0xC0);             // add al, al
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_LD_I:
+				a.byte(0x41); a.byte(0xBC); a.dword(inst.nnn); // mov r12d, nnn
+				break;
+
+			case OP_ADD_I:
+				a.movzx_eax_mem8(VX);
+				a.byte(0x44); a.byte(0x01); a.byte(0xE0);      // add eax, r12d
+				a.byte(0x3D); a.dword(255);                    // cmp eax, 255
+				a.setcc_cl(CC_A);
+				a.mov_mem_cl(VF);
+				a.movzx_eax_mem8(VX);
+				a.byte(0x41); a.byte(0x01); a.byte(0xC4);      // add r12d, eax
+				a.byte(0x41); a.byte(0x81); a.byte(0xE4);      // and r12d, 0xFFFF
+				a.dword(0xFFFF);
+				break;
+
+			case OP_LD_F:
+				// Digits over 0xF are left to the interpreter, which raises a fault
+				a.alu_mem_imm8(0x80, 7, VX, 0xF);              // cmp [Vx], 0xF
+				side_exits.push_back({a.jcc(CC_A, a.p), inst_pc, give_back});
+				a.movzx_eax_mem8(VX);
+				a.byte(0x44); a.byte(0x8D); a.byte(0x24); a.byte(0x80); // lea r12d, [rax+rax*4]
+				break;
+
+			case OP_LD_VX_DT:
+				a.mov_al_mem(off_dt);
+				a.mov_mem_al(VX);
+				break;
+
+			case OP_LD_DT_VX:
+				a.mov_al_mem(VX);
+				a.mov_mem_al(off_dt);
+				break;
+
+			case OP_LD_ST_VX:
+				a.mov_al_mem(VX);
+				a.mov_mem_al(off_st);
+				break;
+
+			case OP_LD_VX_MEM:
+				// Reads out of memory or across pages are left to the
+				// interpreter
+				a.byte(0x41); a.byte(0x81); a.byte(0xFC);      // cmp r12d, size-(x+1)
+				a.dword(mem_size - (inst.x+1));
+				side_exits.push_back({a.jcc(CC_A, a.p), inst_pc, give_back});
+				a.byte(0x44); a.byte(0x89); a.byte(0xE0);      // mov eax, r12d
+				a.byte(0x25); a.dword(GuestMemory::PAGE_MASK); // and eax, mask
+				a.byte(0x3D);                                  // cmp eax, page-(x+1)
+				a.dword(GuestMemory::PAGE_SIZE - (inst.x+1));
+				side_exits.push_back({a.jcc(CC_A, a.p), inst_pc, give_back});
+
+				// rdx = page, rax = offset in the page
+				a.byte(0x44); a.byte(0x89); a.byte(0xE2);      // mov edx, r12d
+				a.byte(0xC1); a.byte(0xEA); a.byte(GuestMemory::PAGE_BITS); // shr edx, bits
+				a.byte(0x48); a.byte(0x8B); a.byte(0x94); a.byte(0xD3); // mov rdx, [rbx+rdx*8+disp32]
+				a.dword(off_pages);
+				for (int r = 0; r <= inst.x; r++){
+					a.byte(0x8A); a.byte(0x4C); a.byte(0x02); a.byte(r); // mov cl, [rdx+rax+r]
+					a.mov_mem_cl(off_regs + r);
+				}
+				break;
+
+			case OP_JP:
+				static_exits.push_back({a.jmp(a.p), inst.nnn});
+				break;
+
+			case OP_CALL:
+				// Let the interpreter handle stack overflows
+				a.movzx_eax_mem8(off_sp);
+				a.byte(0x83); a.byte(0xF8); a.byte(14);        // cmp eax, 14
+				side_exits.push_back({a.jcc(CC_A, a.p), inst_pc, give_back});
+				a.byte(0xFF); a.byte(0xC0);                    // inc eax
+				a.mov_mem_al(off_sp);
+				a.byte(0x66); a.byte(0xC7); a.byte(0x84); a.byte(0x43); // mov word [rbx+rax*2+stack], pc
+				a.dword(off_stack);
+				a.word(inst_pc);
+				static_exits.push_back({a.jmp(a.p), inst.nnn});
+				break;
+
+			case OP_RET:
+				// Let the interpreter handle stack underflows
+				a.movzx_eax_mem8(off_sp);
+				a.byte(0x85); a.byte(0xC0);                    // test eax, eax
+				side_exits.push_back({a.jcc(CC_E, a.p), inst_pc, give_back});
+				a.byte(0x0F); a.byte(0xB7); a.byte(0x8C); a.byte(0x43); // movzx ecx, word [rbx+rax*2+stack]
+				a.dword(off_stack);
+				a.byte(0xFF); a.byte(0xC8);                    // dec eax
+				a.mov_mem_al(off_sp);
+				a.byte(0x83); a.byte(0xC1); a.byte(2);         // add ecx, 2
+				dynamic_exit();
+				break;
+
+			case OP_JP_V0:
+				a.byte(0x0F); a.byte(0xB6); a.mem(1, off_regs); // movzx ecx, [V0]
+				a.byte(0x81); a.byte(0xC1); a.dword(inst.nnn);  // add ecx, nnn
+				dynamic_exit();
+				break;
+
+			case OP_SE_BYTE:
+			case OP_SNE_BYTE:
+			case OP_SE_REG:
+			case OP_SNE_REG: {
+				if (inst.op == OP_SE_BYTE || inst.op == OP_SNE_BYTE)
+					a.alu_mem_imm8(0x80, 7, VX, inst.kk);  // cmp [Vx], kk
+				else {
+					a.mov_al_mem(VX);
+					a.alu_al_mem(0x3A, VY);                // cmp al, [Vy]
+				}
+				uint8_t cc = (inst.op == OP_SE_BYTE || inst.op == OP_SE_REG ? CC_E : CC_NE);
+				static_exits.push_back({a.jcc(cc, a.p), (uint16_t)(inst_pc+4)});
+				static_exits.push_back({a.jmp(a.p), (uint16_t)(inst_pc+2)});
+				break;
+			}
+
+			default:
+				// Not reached, see translatable()
+				break;
+		}
+	}
+
+	// If the block didn't end with a control flow instruction, continue to
+	// the next one
+	if (!ends_block)
+		static_exits.push_back({a.jmp(a.p), end});
+
+	// Emit static exits. They jump to a stub that writes pc and returns to
+	// C++ asking to link the exit site with the target block
+	for (const StaticExit& s : static_exits){
+		uint8_t* stub = a.p;
+		a.byte(0x66); a.byte(0xC7); a.mem(0, off_pc); a.word(s.target); // mov [pc], target
+		a.byte(0x48); a.byte(0xB8); a.qword((uint64_t)s.site);        // mov rax, site
+		a.jmp(exit_link);
+		link(s.site, stub);
+	}
+
+	// Emit side exits
+	for (const SideExit& s : side_exits){
+		uint8_t* stub = a.p;
+		if (s.budget){
+			a.byte(0x41); a.byte(0x83); a.byte(0xC5); a.byte(s.budget); // add r13d, budget
+		}
+		a.byte(0x66); a.byte(0xC7); a.mem(0, off_pc); a.word(s.pc);    // mov [pc], pc
+		a.jmp(exit_nolink);
+		link(s.site, stub);
+	}
+
+	assert(a.p <= block + max_size);
+	code_cur = a.p;
+	block_size[pc] = end - pc;
+	for (uint16_t i = pc; i < end; i++)
+		code_refs[i]++;
+	return block;
+}
+
+void Jit::link(uint8_t* site, uint8_t* target){
+	int32_t rel = target - (site + 4);
+	memcpy(site, &rel, sizeof(rel));
+}
+
+void Jit::chain(uint8_t* site, uint16_t target){
+	// The site still jumps to its stub
+	int32_t rel;
+	memcpy(&rel, site, sizeof(rel));
+	chains.push_back({site, site + 4 + rel, target});
+	link(site, blocks[target]);
+}
+
+uint Jit::run(uint max_inst){
+	// Addresses out of memory fault in the interpreter
+	uint16_t pc = emu.pc;
+	if (pc >= sizeof(blocks)/sizeof(blocks[0]) || interp_only[pc])
+		return 0;
+	if (!blocks[pc]){
+		blocks[pc] = compile(pc);
+		if (!blocks[pc]){
+			interp_only[pc] = true;
+			return 0;
+		}
+	}
+
+	if (!protect(false))
+		return 0;
+
+	uint32_t budget = max_inst;
+	uint8_t* site = enter(&emu, blocks[pc], &budget, blocks);
+
+	// Link the exit site with the next block if it is translated, or if it
+	// can be translated. Idle loops aren't linked, so they return to
+	// run_frame() which skips them
+	pc = emu.pc;
+	if (site && pc < sizeof(blocks)/sizeof(blocks[0]) && !interp_only[pc] &&
+	    !emu.idle_loop_length(pc)){
+		if (!blocks[pc]){
+			// Compiling may flush the cache, which invalidates `site`
+			uint8_t* cur = code_cur;
+			blocks[pc] = compile(pc);
+			if (!blocks[pc])
+				interp_only[pc] = true;
+			else if (code_cur < cur)
+				site = NULL;
+		}
+		if (blocks[pc] && site && protect(true))
+			chain(site, pc);
+	}
+	return max_inst - budget;
+}
+
+void Jit::translate(const Cfg& cfg){
+	// Besides the start of each block, translated code is entered after the
+	// instructions left to the interpreter
+	const uint16_t mem_size = GuestMemory::SIZE;
+	for (const Cfg::Block& block : cfg.get_blocks()){
+		for (uint16_t pc = block.start; pc < block.end && pc < mem_size-1; pc += 2){
+			bool ends_block;
+			if (pc != block.start && translatable(emu.memory.fetch(pc-2).op, ends_block))
+				continue;
+			if (blocks[pc] || interp_only[pc])
+				continue;
+			uint8_t* cur = code_cur;
+			blocks[pc] = compile(pc);
+			if (!blocks[pc])
+				interp_only[pc] = true;
+			else if (code_cur < cur)
+				return;
+		}
+	}
+}
+
+#else
+
+bool Jit::supported(){
+	return false;
+}
+
+Jit* Jit::create(Emulator& emu){
+	return NULL;
+}
+
+Jit::~Jit(){ }
+
+uint Jit::run(uint max_inst){
+	return 0;
+}
+
+void Jit::translate(const Cfg& cfg){ }
+
+void Jit::invalidate(uint16_t start, uint16_t end){ }
+
+void Jit::flush(){ }
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+template <class V> class BasicEmulator;
+struct Chip8;
+typedef BasicEmulator<Chip8> Emulator;
+class Cfg;
+
+// Dynamic recompiler that translates CHIP-8 basic blocks into x86-64 code.
+// A block ends at the first instruction that may change the control flow
+// (1nnn, 2nnn, 00EE, Bnnn and skips), or right before an instruction the
+// JIT doesn't handle (Dxyn, Fx0A, memory writes...), which are left to the
+// interpreter.
+//
+// Inside a block, `I` is pinned to r12d and the remaining instruction budget
+// to r13d. `pc` is a constant known at compile time, so it is only written
+// back when exiting. V registers are accessed as memory operands relative to
+// rbx, which points to the emulator.
+//
+// Blocks are chained: static exits are patched to jump directly to the next
+// block, and dynamic exits (00EE, Bnnn) look up the next block in a table.
+// Writes to memory only throw away the blocks they overlap, and the exits
+// chained to them are sent back to their stubs.
+//
+// The code cache is never writable and executable at the same time: it is
+// made writable to translate or link blocks, and executable to run them.
+class Jit {
+	public:
+		// Is the JIT supported on this host?
+		static bool supported();
+
+		// Create a JIT for `emu`. Returns NULL if the JIT isn't supported or
+		// the host doesn't let it allocate executable memory
+		static Jit* create(Emulator& emu);
+		~Jit();
+
+		// Run translated code starting at `emu.pc` until `max_inst`
+		// instructions have been run or until an instruction must be run by
+		// the interpreter. Returns the number of instructions run, which is
+		// 0 if the instruction at `emu.pc` must be run by the interpreter.
+		uint run(uint max_inst);
+
+		// Translate ahead of time the code found by `cfg`, so it doesn't
+		// have to be translated while running. Stops if the code cache fills
+		void translate(const Cfg& cfg);
+
+		// Notify a write to memory in the range [`start`, `end`)
+		void invalidate(uint16_t start, uint16_t end);
+
+		// Throw away all translated code
+		void flush();
+
+	private:
+		// Size of the code cache
+		static const size_t CODE_SIZE = 1024*1024;
+
+		// Maximum instructions in a block
+		static const int MAX_BLOCK_INST = 64;
+
+		// Function that enters translated code at `code`. It updates
+		// `budget` and returns the address of the exit site that should be
+		// linked to the block at `emu->pc`, or NULL
+		typedef uint8_t* (*EnterFunc)(Emulator* emu, uint8_t* code,
+		                              uint32_t* budget, uint8_t** table);
+
+		Emulator& emu;
+
+		// Executable memory for translated code. The first bytes contain
+		// the enter and exit routines
+		uint8_t* code;
+		uint8_t* code_end;
+		uint8_t* code_cur;
+		uint8_t* code_blocks_start;
+
+		// Common routines
+		EnterFunc enter;
+		uint8_t*  exit_link;   // Return to C++, with rax = exit site to link
+		uint8_t*  exit_nolink; // Return to C++, with nothing to link
+
+		// Translated block at each address, or NULL
+		uint8_t* blocks[4096];
+
+		// Addresses that must be run by the interpreter
+		bool interp_only[4096];
+
+		// Bytes of guest code translated into the block at each address
+		uint8_t block_size[4096];
+
+		// Number of blocks translated from each address
+		uint8_t code_refs[4096];
+
+		// Exit site linked to the block at `target`, and the stub it
+		// jumped to before being linked
+		struct Chain {
+			uint8_t* site;
+			uint8_t* stub;
+			uint16_t target;
+		};
+		std::vector<Chain> chains;
+
+		// Is the code cache currently writable (and not executable)?
+		bool writable;
+
+		// Offsets of the emulator fields from the emulator address
+		int32_t off_regs, off_I, off_pc, off_sp, off_stack, off_dt, off_st;
+		int32_t off_pages;
+
+		Jit(Emulator& emu, uint8_t* code);
+
+		// Make the code cache writable or executable. Returns false if the
+		// protection can't be changed
+		bool protect(bool writable);
+
+		// Emit the enter and exit routines
+		void emit_routines();
+
+		// Translate the block starting at `pc`. Returns NULL if the
+		// instruction at `pc` can't be translated
+		uint8_t* compile(uint16_t pc);
+
+		// Patch the exit site `site` to jump to `target`
+		void link(uint8_t* site, uint8_t* target);
+
+		// Link the static exit site `site` to the block at `target`,
+		// remembering how to unlink it
+		void chain(uint8_t* site, uint16_t target);
+
+		// Throw away the block at `pc` and unlink the exits chained to it
+		void drop_block(uint16_t pc);
+};
+
+#endif
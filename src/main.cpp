@@ -1,16 +1,260 @@
 #include <stdio.h>
-#include <SDL2/SDL.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <thread>
 #include "emulator.h"
+#include "movie.h"
+#include "capture.h"
+#ifdef CHIP8_SDL
+#include "frontend_sdl.h"
+#endif
 
-int main(int argc, char** argv){
-	if (argc != 2){
-		fprintf(stderr, "Usage: %s romfile\n", argv[0]);
-		exit(EXIT_FAILURE);
+void usage(const char* prog){
+	fprintf(stderr, "Usage: %s [-V chip8|schip|xochip] "
+	                "[-b switch|threaded|jit] [-r rewind-seconds] "
+	                "[-s seed] [-t] [-m record.movie | -p replay.movie [-c capture]] "
+#ifdef CHIP8_PROFILE
+	                "[-P profile.folded] "
+#endif
+	                "romfile [instructions-per-frame]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+#ifdef CHIP8_PROFILE
+// Write the profile to `path` in collapsed stack format, and a summary to
+// stdout
+void write_profile(const Profiler& profiler, const char* path){
+	FILE* f = fopen(path, "w");
+	if (!f){
+		perror(path);
+		return;
+	}
+	profiler.write_collapsed(f);
+	fclose(f);
+	profiler.write_report(stdout);
+	printf("Call stacks written to %s\n", path);
+}
+#endif
+
+// Command line options
+struct Options {
+	EmulatorBase::Backend backend;
+	uint        rewind_seconds;
+	uint32_t    seed;
+	const char* record_path;
+	const char* replay_path;
+	const char* profile_path;
+	const char* capture_path;
+	bool        turbo;
+	uint        inst_per_frame;
+};
+
+// Run `movie` headless as fast as possible with the emulator of the variant
+// `V`, and print a hash of the final screen so runs can be compared. The
+// screen of every frame is captured into `capture_path` if it's given
+template <class V>
+int replay(const char* filename, const char* movie_path,
+           EmulatorBase::Backend backend, const char* profile_path,
+           const char* capture_path){
+	Movie movie;
+	if (!movie.load(movie_path)){
+		fprintf(stderr, "Error loading movie %s\n", movie_path);
+		return EXIT_FAILURE;
+	}
+
+	ReplayFrontend frontend(movie);
+	BasicEmulator<V> emu(filename, frontend);
+	emu.set_backend(backend);
+	emu.set_seed(movie.seed);
+#ifdef CHIP8_PROFILE
+	Profiler profiler;
+	if (profile_path)
+		emu.profile(&profiler);
+#endif
+	std::unique_ptr<Capture> capture;
+	if (capture_path)
+		capture.reset(new Capture(capture_path,
+		                          Capture::format_for(capture_path)));
+	size_t frames;
+	for (frames = 0; frames < movie.size() && emu.is_running(); frames++){
+		emu.run_frame(movie.inst_per_frame);
+		if (capture)
+			capture->frame(emu.get_framebuf());
+	}
+	if (capture){
+		if (capture->close())
+			printf("Captured %lu frames as %lu images to %s\n",
+			       capture->frames(), capture->images(), capture_path);
+		else
+			fprintf(stderr, "Error capturing: %s\n",
+			        capture->get_error().c_str());
 	}
-	
-	printf("Loading %s\n", argv[1]);
+#ifdef CHIP8_PROFILE
+	if (profile_path)
+		write_profile(profiler, profile_path);
+#endif
 
-	Emulator emu(argv[1]);
-	emu.run(3000); // This can be changed for faster or slower game
+	if (!emu.get_fault().empty()){
+		fprintf(stderr, "Fault after %zu frames: %s\n", frames,
+		        emu.get_fault().c_str());
+		return EXIT_FAILURE;
+	}
+	printf("Replayed %zu frames, screen hash %016lx\n", frames,
+	       emu.screen_hash());
+	return EXIT_SUCCESS;
+}
+
+// Run `filename` in a window with the emulator of the variant `V`, until
+// it's closed
+template <class V>
+int play(const char* filename, const Options& opt){
+#ifdef CHIP8_SDL
+	Movie movie(opt.seed, opt.inst_per_frame);
+	SDLFrontend frontend(basename((char*)filename), V::SCREEN_W, V::SCREEN_H,
+	                     V::PLANES);
+	BasicEmulator<V> emu(filename, frontend);
+	emu.set_backend(opt.backend);
+	emu.set_seed(opt.seed);
+	if constexpr (!V::SCHIP) // Only CHIP-8 can rewind
+		emu.enable_rewind(opt.rewind_seconds);
+	if (opt.turbo)
+		emu.set_turbo(true);
+	if (opt.record_path)
+		emu.record(&movie);
+#ifdef CHIP8_PROFILE
+	Profiler profiler;
+	if (opt.profile_path)
+		emu.profile(&profiler);
+#endif
+
+	// SDL must be used by this thread, so the emulator runs in another one
+	std::thread emulation([&](){
+		emu.run(opt.inst_per_frame);
+		frontend.stop();
+	});
+	frontend.loop();
+	emulation.join();
+#ifdef CHIP8_PROFILE
+	if (opt.profile_path)
+		write_profile(profiler, opt.profile_path);
+#endif
+	if (!emu.get_fault().empty()){
+		fprintf(stderr, "Fault: %s\n", emu.get_fault().c_str());
+		return EXIT_FAILURE;
+	}
+
+	if (opt.record_path){
+		if (movie.save(opt.record_path))
+			printf("Saved %zu frames to %s\n", movie.size(), opt.record_path);
+		else
+			fprintf(stderr, "Error saving movie to %s\n", opt.record_path);
+	}
 	printf("DONE\n");
-}
\ No newline at end of file
+	return EXIT_SUCCESS;
+#else
+	fprintf(stderr, "Built without SDL, only movies can be replayed (-p)\n");
+	return EXIT_FAILURE;
+#endif
+}
+
+// Replay a movie if there's one, or play
+template <class V>
+int run(const char* filename, const Options& opt){
+	// Replaying doesn't need a window. The movie has the seed and the
+	// number of instructions per frame
+	if (opt.replay_path)
+		return replay<V>(filename, opt.replay_path, opt.backend,
+		                 opt.profile_path, opt.capture_path);
+	return play<V>(filename, opt);
+}
+
+int main(int argc, char** argv){
+	// Parse options
+	Options opt;
+	opt.backend        = Emulator::BACKEND_SWITCH;
+	opt.rewind_seconds = 60;
+	opt.seed           = time(NULL);
+	opt.record_path    = NULL;
+	opt.replay_path    = NULL;
+	opt.profile_path   = NULL;
+	opt.capture_path   = NULL;
+	opt.turbo          = false;
+	const char* variant = "chip8";
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "V:b:r:s:tm:p:c:P:")) != -1){
+		switch (opt_char){
+			case 'V':
+				variant = optarg;
+				if (strcmp(variant, "chip8") && strcmp(variant, "schip") &&
+				    strcmp(variant, "xochip"))
+					usage(argv[0]);
+				break;
+
+			case 'b':
+				if (!Emulator::parse_backend(optarg, opt.backend))
+					usage(argv[0]);
+				break;
+
+			case 'r':
+				opt.rewind_seconds = atoi(optarg);
+				break;
+
+			case 's':
+				opt.seed = strtoul(optarg, NULL, 0);
+				break;
+
+			case 't':
+				opt.turbo = true;
+				break;
+
+			case 'm':
+				opt.record_path = optarg;
+				break;
+
+			case 'p':
+				opt.replay_path = optarg;
+				break;
+
+			case 'c':
+				opt.capture_path = optarg;
+				break;
+
+#ifdef CHIP8_PROFILE
+			case 'P':
+				opt.profile_path = optarg;
+				break;
+#endif
+
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 && argc - optind != 2)
+		usage(argv[0]);
+	if ((opt.record_path && opt.replay_path) ||
+	    (opt.capture_path && !opt.replay_path))
+		usage(argv[0]);
+	const char* filename = argv[optind];
+
+	// Instructions run each frame. This can be changed for faster or slower
+	// game, timers always run at 60Hz
+	opt.inst_per_frame = Emulator::DEFAULT_INST_PER_FRAME;
+	if (argc - optind == 2)
+		opt.inst_per_frame = atoi(argv[optind+1]);
+
+	// Captures and profiles are only of CHIP-8 screens and programs
+	bool classic = !strcmp(variant, "chip8");
+	if (!classic && (opt.capture_path || opt.profile_path)){
+		fprintf(stderr, "Capturing and profiling are only supported in CHIP-8\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Loading %s\n", filename);
+	if (classic)
+		return run<Chip8>(filename, opt);
+	if (!strcmp(variant, "schip"))
+		return run<SuperChip>(filename, opt);
+	return run<XoChip>(filename, opt);
+}
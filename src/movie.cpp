@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "movie.h"
+
+// Movie files are a header followed by the keys state of each frame, all in
+// little endian:
+//   magic          "C8MV"
+//   version        uint16
+//   seed           uint32
+//   inst_per_frame uint32
+//   frames         uint32
+//   keys           uint16[frames]
+const char MOVIE_MAGIC[4] = { 'C', '8', 'M', 'V' };
+const uint16_t MOVIE_VERSION = 1;
+const size_t MOVIE_HEADER_SIZE = 18;
+
+static void put16(uint8_t* p, uint16_t v){ p[0] = v; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v){ put16(p, v); put16(p+2, v >> 16); }
+static uint16_t get16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t* p){ return get16(p) | ((uint32_t)get16(p+2) << 16); }
+
+Movie::Movie(uint32_t seed, uint32_t inst_per_frame)
+	: seed(seed)
+	, inst_per_frame(inst_per_frame)
+{
+}
+
+size_t Movie::size() const {
+	return frames.size();
+}
+
+uint16_t Movie::keys(size_t frame) const {
+	return frames[frame];
+}
+
+void Movie::push(uint16_t keys){
+	frames.push_back(keys);
+}
+
+void Movie::pop(){
+	if (!frames.empty())
+		frames.pop_back();
+}
+
+bool Movie::save(const char* filename) const {
+	std::vector<uint8_t> data(MOVIE_HEADER_SIZE + frames.size()*2);
+	memcpy(&data[0], MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+	put16(&data[4], MOVIE_VERSION);
+	put32(&data[6], seed);
+	put32(&data[10], inst_per_frame);
+	put32(&data[14], frames.size());
+	for (size_t i = 0; i < frames.size(); i++)
+		put16(&data[MOVIE_HEADER_SIZE + i*2], frames[i]);
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	bool ok = (fwrite(data.data(), data.size(), 1, f) == 1);
+	ok &= (fclose(f) == 0);
+	return ok;
+}
+
+bool Movie::load(const char* filename){
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+
+	// The frame count isn't trusted until it matches the file size, so a
+	// corrupt header can't make it allocate gigabytes
+	uint8_t header[MOVIE_HEADER_SIZE];
+	struct stat st;
+	if (fstat(fileno(f), &st) == -1 ||
+	    fread(header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header, MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) ||
+	    get16(&header[4]) != MOVIE_VERSION ||
+	    (uint64_t)st.st_size != MOVIE_HEADER_SIZE + (uint64_t)get32(&header[14])*2){
+		fclose(f);
+		errno = EINVAL;
+		return false;
+	}
+	seed           = get32(&header[6]);
+	inst_per_frame = get32(&header[10]);
+
+	std::vector<uint8_t> data((size_t)get32(&header[14])*2);
+	bool ok = data.empty() || (fread(data.data(), data.size(), 1, f) == 1);
+	fclose(f);
+	if (!ok){
+		errno = EINVAL;
+		return false;
+	}
+	frames.resize(data.size()/2);
+	for (size_t i = 0; i < frames.size(); i++)
+		frames[i] = get16(&data[i*2]);
+	return true;
+}
+
+ReplayFrontend::ReplayFrontend(const Movie& movie)
+	: movie(movie)
+	, frame(0)
+{
+}
+
+uint32_t ReplayFrontend::update_keys(std::bitset<0x10>& keys){
+	if (frame == movie.size())
+		return CMD_QUIT;
+	keys = movie.keys(frame++);
+	return CMD_NONE;
+}
+
+void ReplayFrontend::wait_input(int timeout_ms){
+}
@@ -0,0 +1,55 @@
+#ifndef _MOVIE_H
+#define _MOVIE_H
+
+#include <cstdint>
+#include <vector>
+#include "frontend_null.h"
+
+// Input movie: the keys state of every frame, plus what is needed to run the
+// emulator again in the same way: the random seed and the number of
+// instructions per frame. Replaying a movie from power on reproduces the run
+// exactly.
+class Movie {
+	public:
+		uint32_t seed;
+		uint32_t inst_per_frame;
+
+		Movie(uint32_t seed = 0, uint32_t inst_per_frame = 0);
+
+		// Number of frames
+		size_t size() const;
+
+		// Keys state at `frame`, bit i set means key i is pressed
+		uint16_t keys(size_t frame) const;
+
+		// Add a frame at the end
+		void push(uint16_t keys);
+
+		// Remove the last frame, used when rewinding while recording
+		void pop();
+
+		// Save to or load from `filename`. Return false on error
+		bool save(const char* filename) const;
+		bool load(const char* filename);
+
+	private:
+		std::vector<uint16_t> frames;
+};
+
+// Headless frontend that takes keys from a movie, one frame each time keys
+// are updated, and asks to quit when the movie ends
+class ReplayFrontend : public NullFrontend {
+	private:
+		const Movie& movie;
+		size_t       frame;
+
+	public:
+		ReplayFrontend(const Movie& movie);
+
+		uint32_t update_keys(std::bitset<0x10>& keys);
+
+		// Keys of the next frame are always available
+		void wait_input(int timeout_ms);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <string.h>
+#include <algorithm>
+#include "profiler.h"
+
+Profiler::Profiler()
+	: total(0)
+	, node(0)
+	, depth(0)
+{
+	memset(pc_count, 0, sizeof(pc_count));
+	memset(op_count, 0, sizeof(op_count));
+	nodes.push_back({0x200, -1, 0, {}});
+}
+
+int Profiler::child(int parent, uint16_t func){
+	for (int c : nodes[parent].children)
+		if (nodes[c].func == func)
+			return c;
+	nodes.push_back({func, parent, 0, {}});
+	int c = nodes.size() - 1;
+	nodes[parent].children.push_back(c);
+	return c;
+}
+
+void Profiler::sample(uint16_t pc, Op op, const uint16_t* stack, uint8_t sp,
+                      const GuestMemory& memory){
+	// Follow the stack. Every instruction is sampled, so usually it only
+	// changes by one call or return. Otherwise (for example, after loading
+	// a state), rebuild the path from the CALL instructions in the stack
+	if (sp == depth + 1)
+		node = child(node, pc);
+	else if (sp + 1 == depth)
+		node = nodes[node].parent;
+	else if (sp != depth){
+		node = 0;
+		for (int i = 1; i <= sp; i++){
+			uint16_t call = stack[i];
+			uint16_t func = 0;
+			if (call < GuestMemory::SIZE && memory.fetch(call).op == OP_CALL)
+				func = memory.fetch(call).nnn;
+			node = child(node, func);
+		}
+	}
+	depth = sp;
+
+	if (pc < sizeof(pc_count)/sizeof(pc_count[0]))
+		pc_count[pc]++;
+	op_count[op]++;
+	nodes[node].count++;
+	total++;
+}
+
+void Profiler::write_stack(FILE* f, int node) const {
+	if (nodes[node].parent != -1){
+		write_stack(f, nodes[node].parent);
+		fprintf(f, ";FUNCTION 0x%X", nodes[node].func);
+	} else
+		fprintf(f, "START");
+}
+
+void Profiler::write_collapsed(FILE* f) const {
+	for (size_t i = 0; i < nodes.size(); i++){
+		if (!nodes[i].count)
+			continue;
+		write_stack(f, i);
+		fprintf(f, " %lu\n", nodes[i].count);
+	}
+}
+
+void Profiler::write_report(FILE* f, size_t top) const {
+	fprintf(f, "%lu instructions\n", total);
+	if (!total)
+		return;
+
+	// Operations, most run first
+	std::vector<int> ops;
+	for (int op = 0; op < OP_COUNT; op++)
+		if (op_count[op])
+			ops.push_back(op);
+	std::sort(ops.begin(), ops.end(), [&](int a, int b){
+		return op_count[a] > op_count[b];
+	});
+	fprintf(f, "\nBy operation:\n");
+	for (int op : ops)
+		fprintf(f, "    %-20s %12lu %6.2f%%\n", op_name((Op)op), op_count[op],
+		        100.0 * op_count[op] / total);
+
+	// Hottest addresses
+	std::vector<uint16_t> addrs;
+	for (size_t pc = 0; pc < sizeof(pc_count)/sizeof(pc_count[0]); pc++)
+		if (pc_count[pc])
+			addrs.push_back(pc);
+	std::sort(addrs.begin(), addrs.end(), [&](uint16_t a, uint16_t b){
+		return pc_count[a] > pc_count[b];
+	});
+	if (addrs.size() > top)
+		addrs.resize(top);
+	fprintf(f, "\nHottest addresses:\n");
+	for (uint16_t pc : addrs)
+		fprintf(f, "    %04X: %12lu %6.2f%%\n", pc, pc_count[pc],
+		        100.0 * pc_count[pc] / total);
+}
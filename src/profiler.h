@@ -0,0 +1,60 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "guest_memory.h"
+#include "inst.h"
+
+// Execution profiler. It counts the instructions run at each address and of
+// each operation, and builds a call tree from the CHIP-8 stack: a function
+// is identified by the address called by 2nnn, and each instruction is
+// counted in the function at the top of the stack.
+//
+// Emulator only uses it when built with CHIP8_PROFILE, otherwise it has no
+// cost at all.
+class Profiler {
+	public:
+		Profiler();
+
+		// Record that the instruction `op` at `pc` is going to run. `stack`
+		// and `sp` are the emulator ones, `memory` is used to find the
+		// functions of the stack frames
+		void sample(uint16_t pc, Op op, const uint16_t* stack, uint8_t sp,
+		            const GuestMemory& memory);
+
+		// Write the call stacks in collapsed format, one line per stack
+		// with the number of instructions run in it, such as
+		// "START;FUNCTION 0x2A0;FUNCTION 0x34C 1234". It can be turned
+		// into a flame graph with flamegraph.pl
+		void write_collapsed(FILE* f) const;
+
+		// Write the instructions run by operation, and the `top` addresses
+		// that ran most instructions
+		void write_report(FILE* f, size_t top = 20) const;
+
+	private:
+		// A function in the call tree. Function 0 is the root, START
+		struct Node {
+			uint16_t func;     // Address of the function
+			int      parent;   // Index of the caller
+			uint64_t count;    // Instructions run in this function
+			std::vector<int> children;
+		};
+
+		uint64_t pc_count[4096];
+		uint64_t op_count[OP_COUNT];
+		uint64_t total;
+
+		std::vector<Node> nodes;
+		int node;  // Current function
+		int depth; // Depth of `node`, which must match sp
+
+		// Get the node of `func` called from `parent`, creating it if needed
+		int child(int parent, uint16_t func);
+
+		void write_stack(FILE* f, int node) const;
+};
+
+#endif
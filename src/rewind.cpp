@@ -0,0 +1,230 @@
+#include <string.h>
+#include <assert.h>
+#include "rewind.h"
+
+// The encoding is a sequence of tokens, each one being the number of zero
+// bytes to skip and the number of literal bytes that follow, as varints, and
+// then the literal bytes.
+
+// A run of zeros shorter than this is kept inside the literal, because
+// starting a new token would take more space
+const size_t MIN_ZERO_RUN = 3;
+
+static const State ZERO_STATE = State();
+
+static uint8_t* put_varint(uint8_t* out, size_t value){
+	while (value >= 0x80){
+		*out++ = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+	return out;
+}
+
+static const uint8_t* get_varint(const uint8_t* in, size_t& value){
+	value = 0;
+	int shift = 0;
+	uint8_t b;
+	do {
+		b = *in++;
+		value |= (size_t)(b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return in;
+}
+
+size_t rle_max_size(){
+	// Every token but the last one covers at least MIN_ZERO_RUN bytes, and
+	// each varint takes at most 3 bytes
+	return sizeof(State) + (sizeof(State)/MIN_ZERO_RUN + 2)*6;
+}
+
+size_t rle_encode(const State& state, const State& base, uint8_t* out){
+	const uint8_t* a = (const uint8_t*)&state;
+	const uint8_t* b = (const uint8_t*)&base;
+	const size_t size = sizeof(State);
+	uint8_t* start = out;
+	size_t i = 0;
+	while (i < size){
+		// Zeros
+		size_t zeros = 0;
+		while (i + zeros < size && a[i+zeros] == b[i+zeros])
+			zeros++;
+		i += zeros;
+		if (i == size)
+			break;
+
+		// Literal, until a run of zeros long enough or the end
+		size_t lit_start = i, lit_end = i, run = 0;
+		while (i < size && run < MIN_ZERO_RUN){
+			if (a[i] == b[i])
+				run++;
+			else {
+				run = 0;
+				lit_end = i+1;
+			}
+			i++;
+		}
+		i = lit_end;
+
+		out = put_varint(out, zeros);
+		out = put_varint(out, lit_end - lit_start);
+		for (size_t j = lit_start; j < lit_end; j++)
+			*out++ = a[j] ^ b[j];
+	}
+	return out - start;
+}
+
+void rle_decode(const uint8_t* in, size_t len, const State& base, State& state){
+	uint8_t* a = (uint8_t*)&state;
+	const uint8_t* end = in + len;
+	memcpy(&state, &base, sizeof(State));
+	size_t i = 0, zeros, literal;
+	while (in < end){
+		in = get_varint(in, zeros);
+		in = get_varint(in, literal);
+		i += zeros;
+		assert(i + literal <= sizeof(State));
+		for (size_t j = 0; j < literal; j++)
+			a[i++] ^= *in++;
+	}
+}
+
+Rewind::Rewind(size_t max_frames, size_t keyframe_interval, size_t arena_size)
+	: keyframe_interval(keyframe_interval)
+	, entries(max_frames)
+	, first(0)
+	, count(0)
+	, arena(arena_size)
+	, arena_used(0)
+	, next_seq(0)
+	, keyframe_seq(0)
+	, keyframe_valid(false)
+	, encoded(rle_max_size())
+{
+	assert(max_frames > 0 && keyframe_interval > 0);
+	assert(arena_size >= rle_max_size());
+}
+
+Rewind::Entry& Rewind::entry(size_t i){
+	return entries[(first + i) % entries.size()];
+}
+
+size_t Rewind::size() const {
+	return count;
+}
+
+size_t Rewind::memory_used() const {
+	return arena_used;
+}
+
+void Rewind::drop_oldest(){
+	assert(count > 0);
+	Entry e = entry(0);
+	first = (first + 1) % entries.size();
+	count--;
+	arena_used -= e.len;
+
+	// Frames that depend on a dropped keyframe can't be restored anymore
+	if (e.seq == e.keyframe){
+		while (count > 0 && entry(0).keyframe == e.seq){
+			arena_used -= entry(0).len;
+			first = (first + 1) % entries.size();
+			count--;
+		}
+		if (e.seq == keyframe_seq)
+			keyframe_valid = false;
+	}
+}
+
+ssize_t Rewind::find_space(size_t len){
+	if (count == 0)
+		return (len <= arena.size() ? 0 : -1);
+
+	size_t oldest  = entry(0).offset;
+	const Entry& newest = entry(count-1);
+	size_t w = newest.offset + newest.len;
+	if (newest.offset >= oldest){
+		// Used space is [oldest, w). Try after it, then at the beginning
+		if (w + len <= arena.size())
+			return w;
+		if (len <= oldest)
+			return 0;
+	} else {
+		// Used space wraps around. Free space is [w, oldest)
+		if (w + len <= oldest)
+			return w;
+	}
+	return -1;
+}
+
+void Rewind::push(const State& state){
+	if (count == entries.size())
+		drop_oldest();
+
+	bool is_keyframe;
+	size_t len;
+	ssize_t offset;
+	while (true){
+		is_keyframe = !keyframe_valid || next_seq - keyframe_seq >= keyframe_interval;
+		len = rle_encode(state, (is_keyframe ? ZERO_STATE : keyframe),
+		                 encoded.data());
+
+		// Make room. This may drop the keyframe, so check again
+		while ((offset = find_space(len)) < 0)
+			drop_oldest();
+		if (is_keyframe || keyframe_valid)
+			break;
+	}
+
+	memcpy(&arena[offset], encoded.data(), len);
+	Entry& e   = entries[(first + count) % entries.size()];
+	e.offset   = offset;
+	e.len      = len;
+	e.seq      = next_seq++;
+	e.keyframe = (is_keyframe ? e.seq : keyframe_seq);
+	count++;
+	arena_used += len;
+
+	if (is_keyframe){
+		memcpy(&keyframe, &state, sizeof(State));
+		keyframe_seq   = e.seq;
+		keyframe_valid = true;
+	}
+}
+
+bool Rewind::get(size_t age, State& state){
+	if (age >= count)
+		return false;
+
+	size_t i = count - 1 - age;
+	const Entry& e = entry(i);
+	if (e.seq == e.keyframe){
+		rle_decode(&arena[e.offset], e.len, ZERO_STATE, state);
+		return true;
+	}
+
+	// Decode the keyframe first, unless it's the one we have
+	const State* base = &keyframe;
+	if (!keyframe_valid || e.keyframe != keyframe_seq){
+		const Entry& k = entry(i - (e.seq - e.keyframe));
+		assert(k.seq == e.keyframe);
+		rle_decode(&arena[k.offset], k.len, ZERO_STATE, decoded_keyframe);
+		base = &decoded_keyframe;
+	}
+	rle_decode(&arena[e.offset], e.len, *base, state);
+	return true;
+}
+
+bool Rewind::pop(State& state){
+	if (!get(0, state))
+		return false;
+
+	const Entry& e = entry(count-1);
+	if (e.seq == keyframe_seq)
+		keyframe_valid = false;
+	arena_used -= e.len;
+	count--;
+	next_seq--;
+	return true;
+}
@@ -0,0 +1,93 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+#include "state.h"
+
+// Ring buffer holding one State per frame for the last frames. Every
+// `keyframe_interval` frames a keyframe is stored. The rest of the frames
+// are stored as the XOR of the state with the previous keyframe, which is
+// mostly zeros, compressed with RLE. Keyframes are stored with the same
+// encoding, XORed with zeros.
+//
+// Any frame can be restored decoding at most two entries: its keyframe and
+// itself. All memory is allocated in the constructor.
+class Rewind {
+	public:
+		// Create a buffer for `max_frames` frames, using at most
+		// `arena_size` bytes for encoded states
+		Rewind(size_t max_frames, size_t keyframe_interval = 60,
+		       size_t arena_size = 512*1024);
+
+		// Add the state of a new frame. If there's no space left, the
+		// oldest frames are dropped
+		void push(const State& state);
+
+		// Get the state of the frame `age` frames ago, with 0 being the last
+		// pushed frame. Returns false if there's no such frame
+		bool get(size_t age, State& state);
+
+		// Get the state of the last frame and remove it. Returns false if
+		// the buffer is empty
+		bool pop(State& state);
+
+		// Number of frames in the buffer
+		size_t size() const;
+
+		// Bytes used by encoded states
+		size_t memory_used() const;
+
+	private:
+		// An encoded frame
+		struct Entry {
+			size_t   offset;   // Offset in `arena`
+			size_t   len;      // Length of the encoding
+			uint64_t keyframe; // Sequence number of its keyframe
+			uint64_t seq;      // Sequence number of this frame
+		};
+
+		size_t keyframe_interval;
+
+		// Circular buffer of entries. `first` is the index of the oldest one
+		std::vector<Entry> entries;
+		size_t first;
+		size_t count;
+
+		// Circular buffer of encoded states. Encodings don't wrap around:
+		// if one doesn't fit at the end, it is placed at the beginning
+		std::vector<uint8_t> arena;
+		size_t arena_used;
+
+		// Sequence number of the next pushed frame
+		uint64_t next_seq;
+
+		// Last keyframe, and whether it is still in the buffer
+		State    keyframe;
+		uint64_t keyframe_seq;
+		bool     keyframe_valid;
+
+		// Scratch buffers
+		std::vector<uint8_t> encoded;
+		State decoded_keyframe;
+
+		Entry& entry(size_t i);
+		void drop_oldest();
+
+		// Offset where an encoding of `len` bytes would be placed, or -1 if
+		// it doesn't fit without dropping entries
+		ssize_t find_space(size_t len);
+};
+
+// Encode `state` XOR `base` with RLE into `out`, which must have room for
+// rle_max_size() bytes. Returns the length of the encoding
+size_t rle_encode(const State& state, const State& base, uint8_t* out);
+
+// Decode into `state` the encoding `in` of `state` XOR `base`
+void rle_decode(const uint8_t* in, size_t len, const State& base, State& state);
+
+// Maximum length of an encoding
+size_t rle_max_size();
+
+#endif
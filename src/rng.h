@@ -0,0 +1,24 @@
+#ifndef _RNG_H
+#define _RNG_H
+
+#include <cstdint>
+
+// Random number generator used by Cxkk. It's xorshift32, so its whole state
+// is a word that can be saved with the rest of the emulator state.
+
+// Initial state for `seed`. The seed is scrambled so close seeds give
+// different sequences. The state of xorshift can't be zero
+inline uint32_t rng_init(uint32_t seed){
+	uint32_t state = (seed ^ 0x9E3779B9) * 2654435761u;
+	return (state ? state : 1);
+}
+
+// Advance `state` and get a random byte
+inline uint8_t rng_next(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state >> 24;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rom_cache.h"
+#include "emulator.h"
+
+// Where ROMs are loaded
+const uint16_t ROM_START = 0x200;
+
+uint64_t rom_hash(const uint8_t* data, size_t size){
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3;
+	return hash;
+}
+
+// Build the memory image in `memory` first, so `cfg` can analyze it
+static const uint8_t* build_image(uint8_t* memory, const uint8_t* data,
+                                  size_t size){
+	memset(memory, 0, Rom::MEM_SIZE);
+	memcpy(memory, font, sizeof(font));
+	memcpy(memory + ROM_START, data, size);
+	return memory;
+}
+
+Rom::Rom(const char* path, const uint8_t* data, size_t size, uint64_t hash)
+	: path(path)
+	, hash(hash)
+	, size(size)
+	, cfg(build_image(memory, data, size), MEM_SIZE, ROM_START)
+{
+	for (size_t i = 0; i < MEM_SIZE-1; i++)
+		decoded[i] = decode_inst((memory[i] << 8) | memory[i+1]);
+	decoded[MEM_SIZE-1] = decode_inst(memory[MEM_SIZE-1] << 8);
+}
+
+template <class V>
+RomImage<V>::RomImage(const uint8_t* data, size_t size){
+	memset(memory, 0, sizeof(memory));
+	memcpy(memory, font, sizeof(font));
+	memcpy(memory + BIG_FONT_START, big_font, sizeof(big_font));
+	memcpy(memory + ROM_START, data, size);
+	for (size_t i = 0; i < V::MEMORY_SIZE-1; i++)
+		decoded[i] = V::decode((memory[i] << 8) | memory[i+1]);
+	decoded[V::MEMORY_SIZE-1] = V::decode(memory[V::MEMORY_SIZE-1] << 8);
+}
+
+// Map the file `fd`, described by `st`, and call `use` with its contents. It
+// must fit in `mem_size` bytes of memory
+template <class F>
+static bool map_rom(int fd, const struct stat& st, std::string& err, F use,
+                    size_t mem_size = Rom::MEM_SIZE){
+	if (st.st_size > (off_t)(mem_size - ROM_START)){
+		err = "ROM too big";
+		return false;
+	}
+
+	// mmap doesn't take empty files
+	static const uint8_t empty = 0;
+	if (st.st_size == 0){
+		use(&empty, 0);
+		return true;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED){
+		err = std::string("mmap: ") + strerror(errno);
+		return false;
+	}
+	use((const uint8_t*)data, st.st_size);
+	munmap(data, st.st_size);
+	return true;
+}
+
+// Open `filename` and get its attributes. Returns -1 on error
+static int open_rom(const char* filename, struct stat& st, std::string& err){
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1){
+		err = std::string("open: ") + strerror(errno);
+		return -1;
+	}
+	if (fstat(fd, &st) == -1){
+		err = std::string("stat: ") + strerror(errno);
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode)){
+		err = "not a regular file";
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+std::shared_ptr<const Rom> load_rom(const char* filename, std::string& err){
+	struct stat st;
+	int fd = open_rom(filename, st, err);
+	if (fd == -1)
+		return NULL;
+	std::shared_ptr<const Rom> rom;
+	map_rom(fd, st, err, [&](const uint8_t* data, size_t size){
+		rom = std::make_shared<Rom>(filename, data, size, rom_hash(data, size));
+	});
+	close(fd);
+	return rom;
+}
+
+template <class V>
+std::shared_ptr<const RomImage<V>> load_rom_image(const char* filename,
+                                                  std::string& err){
+	struct stat st;
+	int fd = open_rom(filename, st, err);
+	if (fd == -1)
+		return NULL;
+	std::shared_ptr<const RomImage<V>> image;
+	map_rom(fd, st, err, [&](const uint8_t* data, size_t size){
+		image = std::make_shared<RomImage<V>>(data, size);
+	}, V::MEMORY_SIZE);
+	close(fd);
+	return image;
+}
+
+template struct RomImage<SuperChip>;
+template struct RomImage<XoChip>;
+template std::shared_ptr<const RomImage<SuperChip>>
+load_rom_image<SuperChip>(const char* filename, std::string& err);
+template std::shared_ptr<const RomImage<XoChip>>
+load_rom_image<XoChip>(const char* filename, std::string& err);
+
+std::shared_ptr<const Rom> RomCache::find(uint64_t hash, const uint8_t* data,
+                                          size_t size){
+	auto range = by_hash.equal_range(hash);
+	for (auto it = range.first; it != range.second; it++){
+		const Rom& rom = *it->second;
+		if (rom.size == size && !memcmp(rom.memory + ROM_START, data, size))
+			return it->second;
+	}
+	return NULL;
+}
+
+std::shared_ptr<const Rom> RomCache::get(const char* filename, std::string& err){
+	struct stat st;
+	int fd = open_rom(filename, st, err);
+	if (fd == -1)
+		return NULL;
+	FileId id = { st.st_dev, st.st_ino, st.st_size,
+	              st.st_mtim.tv_sec*1000000000LL + st.st_mtim.tv_nsec };
+
+	// If the path was loaded and the file didn't change, it's the same ROM
+	std::unique_lock<std::mutex> guard(lock);
+	auto it = by_path.find(filename);
+	if (it != by_path.end() && it->second.id == id){
+		close(fd);
+		return it->second.rom;
+	}
+	guard.unlock();
+
+	// Read it, and find it by contents. Building a ROM analyzes it, so it's
+	// done without the lock, and another thread may add the same contents
+	// in the meantime
+	std::shared_ptr<const Rom> rom;
+	map_rom(fd, st, err, [&](const uint8_t* data, size_t size){
+		uint64_t hash = rom_hash(data, size);
+		guard.lock();
+		rom = find(hash, data, size);
+		if (!rom){
+			guard.unlock();
+			auto built = std::make_shared<const Rom>(filename, data, size, hash);
+			guard.lock();
+			rom = find(hash, data, size);
+			if (!rom){
+				rom = built;
+				by_hash.emplace(hash, rom);
+			}
+		}
+		by_path[filename] = {id, rom};
+		guard.unlock();
+	});
+	close(fd);
+	return rom;
+}
+
+size_t RomCache::size(){
+	std::lock_guard<std::mutex> guard(lock);
+	return by_hash.size();
+}
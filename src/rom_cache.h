@@ -0,0 +1,104 @@
+#ifndef _ROM_CACHE_H
+#define _ROM_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include "cfg.h"
+#include "inst.h"
+#include "state.h"
+#include "variant.h"
+
+// A loaded ROM: the power on memory image, with the font and the ROM at
+// 0x200, its decoded instructions and its control flow graph. It never
+// changes after it's loaded, so it's shared by every emulator that runs it,
+// which only copies the pages of memory it writes, see GuestMemory.
+struct Rom {
+	static const size_t MEM_SIZE = sizeof(State::memory);
+
+	std::string path; // File it was loaded from first
+	uint64_t    hash; // FNV-1a of the contents
+	size_t      size; // Size of the ROM
+
+	uint8_t memory[MEM_SIZE];
+	Inst    decoded[MEM_SIZE];
+	Cfg     cfg;
+
+	// Build the ROM `path` from its contents `data`, of `size` bytes, which
+	// must fit in memory
+	Rom(const char* path, const uint8_t* data, size_t size, uint64_t hash);
+};
+
+// Load the ROM `filename` without caching it. On error, returns NULL and
+// sets `err`
+std::shared_ptr<const Rom> load_rom(const char* filename, std::string& err);
+
+// Power on memory image of a ROM for the extended variant `V`, with both
+// fonts, and its decoded instructions. They are neither cached nor analyzed,
+// since only the CHIP-8 JIT uses the control flow graph.
+template <class V>
+struct RomImage {
+	uint8_t memory[V::MEMORY_SIZE];
+	Inst    decoded[V::MEMORY_SIZE];
+
+	// Build it from the ROM contents `data`, of `size` bytes, which must fit
+	// in memory
+	RomImage(const uint8_t* data, size_t size);
+};
+
+// Load the ROM `filename` for the extended variant `V`. On error, returns
+// NULL and sets `err`
+template <class V>
+std::shared_ptr<const RomImage<V>> load_rom_image(const char* filename,
+                                                  std::string& err);
+
+// FNV-1a hash of `size` bytes of `data`
+uint64_t rom_hash(const uint8_t* data, size_t size);
+
+// ROMs loaded so far, indexed by path. A path that was already loaded isn't
+// even read again unless the file changed, and copies of the same ROM under
+// different paths are only loaded once: they are found by the hash of their
+// contents, and then compared byte by byte. It's thread safe.
+class RomCache {
+	public:
+		// Get the ROM `filename`, loading it if it isn't cached. On error,
+		// returns NULL and sets `err`
+		std::shared_ptr<const Rom> get(const char* filename, std::string& err);
+
+		// Number of different ROMs in the cache
+		size_t size();
+
+	private:
+		// What a path was when it was loaded
+		struct FileId {
+			dev_t   dev;
+			ino_t   ino;
+			off_t   size;
+			int64_t mtime_ns;
+
+			bool operator==(const FileId& o) const {
+				return dev == o.dev && ino == o.ino && size == o.size &&
+				       mtime_ns == o.mtime_ns;
+			}
+		};
+
+		// ROM loaded from a path
+		struct PathEntry {
+			FileId id;
+			std::shared_ptr<const Rom> rom;
+		};
+
+		std::mutex lock;
+		std::map<std::string, PathEntry> by_path;
+		std::multimap<uint64_t, std::shared_ptr<const Rom>> by_hash;
+
+		// Cached ROM with the contents `data`, of `size` bytes and hash
+		// `hash`, or NULL. `lock` must be held
+		std::shared_ptr<const Rom> find(uint64_t hash, const uint8_t* data,
+		                                size_t size);
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+#include <assert.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "sprite.h"
+
+// Rotate `value` right `n` bits
+static inline uint64_t rotr64(uint64_t value, unsigned n){
+	return (value >> n) | (value << ((64 - n) & 63));
+}
+
+bool draw_sprite(uint64_t* framebuf, const uint8_t* sprite, uint8_t size,
+                 uint8_t x, uint8_t y){
+	static_assert(FRAMEBUF_W == 64, "framebuf rows must be 64 bits");
+	assert(size <= 15);  // max sprite size is 8x15
+
+	// Each row of the sprite is a byte, placed at the left of the row and
+	// rotated right `x` bits, so pixels that go out of the screen wrap
+	// around. Then we detect collisions with an AND and draw with a XOR.
+	x %= FRAMEBUF_W;
+	y %= FRAMEBUF_H;
+
+#ifdef __AVX2__
+	// Process 4 rows at once. Rows are split in two contiguous ranges, the
+	// one until the bottom of the screen and the one that wraps around to
+	// the top, and masked loads and stores are used so we never touch rows
+	// out of each range.
+	uint8_t bytes[16] = {0};
+	memcpy(bytes, sprite, size);
+	const __m128i shift_r = _mm_cvtsi32_si128(x);
+	const __m128i shift_l = _mm_cvtsi32_si128((64 - x) & 63);
+	const __m256i lane_idx = _mm256_setr_epi64x(0, 1, 2, 3);
+	__m256i collision = _mm256_setzero_si256();
+	int first_rows = (y + size > FRAMEBUF_H ? FRAMEBUF_H - y : size);
+	for (int i = 0; i < size; i += 4){
+		// Sprite rows i to i+3, rotated
+		int32_t chunk;
+		memcpy(&chunk, &bytes[i], sizeof(chunk));
+		__m256i rows = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(chunk));
+		rows = _mm256_slli_epi64(rows, 56);
+		rows = _mm256_or_si256(_mm256_srl_epi64(rows, shift_r),
+		                       _mm256_sll_epi64(rows, shift_l));
+
+		// Lanes that belong to each range
+		__m256i lane = _mm256_add_epi64(lane_idx, _mm256_set1_epi64x(i));
+		__m256i in_size  = _mm256_cmpgt_epi64(_mm256_set1_epi64x(size), lane);
+		__m256i in_first = _mm256_cmpgt_epi64(_mm256_set1_epi64x(first_rows), lane);
+		__m256i in_second = _mm256_andnot_si256(in_first, in_size);
+
+		// Rows until the bottom of the screen
+		long long* dst = (long long*)&framebuf[y + i];
+		__m256i old = _mm256_maskload_epi64(dst, in_first);
+		collision = _mm256_or_si256(collision, _mm256_and_si256(old, rows));
+		_mm256_maskstore_epi64(dst, in_first, _mm256_xor_si256(old, rows));
+
+		// Rows that wrap around to the top of the screen
+		if (!_mm256_testz_si256(in_second, in_second)){
+			dst = (long long*)&framebuf[y + i - FRAMEBUF_H];
+			old = _mm256_maskload_epi64(dst, in_second);
+			collision = _mm256_or_si256(collision, _mm256_and_si256(old, rows));
+			_mm256_maskstore_epi64(dst, in_second, _mm256_xor_si256(old, rows));
+		}
+	}
+	return !_mm256_testz_si256(collision, collision);
+
+#else
+	uint64_t pixels_erased = 0;
+	uint64_t row;
+	for (int i = 0; i < size; i++){
+		row = rotr64((uint64_t)sprite[i] << 56, x);
+		uint64_t& dst = framebuf[(y+i) % FRAMEBUF_H];
+		pixels_erased |= dst & row;
+		dst ^= row;
+	}
+	return pixels_erased != 0;
+#endif
+}
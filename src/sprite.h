@@ -0,0 +1,13 @@
+#ifndef _SPRITE_H
+#define _SPRITE_H
+
+#include <cstdint>
+#include "frontend.h"
+
+// Draw the sprite of `size` bytes at `sprite` into `framebuf` (FRAMEBUF_H
+// rows, one word per row, most significant bit first) at `x`, `y` position,
+// wrapping around the edges. Returns whether there was a collision or not
+bool draw_sprite(uint64_t* framebuf, const uint8_t* sprite, uint8_t size,
+                 uint8_t x, uint8_t y);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "state.h"
+
+// Save state files are a header followed by the fields of State, in order,
+// in little endian:
+//   magic   "C8ST"
+//   version uint16
+//   size    uint16, size of the data after the header
+const char STATE_MAGIC[4] = { 'C', '8', 'S', 'T' };
+const size_t STATE_HEADER_SIZE = 8;
+const size_t STATE_DATA_SIZE   = 4096 + 16*2 + 16 + 2 + 1 + 2 + 1 + 1 + 2 +
+                                 FRAMEBUF_H*8 + 4;
+
+// Serializer and deserializer of little endian values
+class Buffer {
+	public:
+		uint8_t* p;
+
+		Buffer(uint8_t* p) : p(p) {}
+
+		template <typename T>
+		void put(T value){
+			for (size_t i = 0; i < sizeof(T); i++)
+				*p++ = (value >> (i*8)) & 0xFF;
+		}
+
+		template <typename T>
+		T get(){
+			T value = 0;
+			for (size_t i = 0; i < sizeof(T); i++)
+				value |= (T)(*p++) << (i*8);
+			return value;
+		}
+
+		void put_bytes(const void* data, size_t size){
+			memcpy(p, data, size);
+			p += size;
+		}
+
+		void get_bytes(void* data, size_t size){
+			memcpy(data, p, size);
+			p += size;
+		}
+};
+
+bool write_state_file(const State& state, const char* filename){
+	uint8_t data[STATE_HEADER_SIZE + STATE_DATA_SIZE];
+	Buffer buf(data);
+	buf.put_bytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+	buf.put<uint16_t>(STATE_VERSION);
+	buf.put<uint16_t>(STATE_DATA_SIZE);
+	buf.put_bytes(state.memory, sizeof(state.memory));
+	for (uint16_t value : state.stack)
+		buf.put(value);
+	buf.put_bytes(state.regs, sizeof(state.regs));
+	buf.put(state.I);
+	buf.put(state.sp);
+	buf.put(state.pc);
+	buf.put(state.delay_timer);
+	buf.put(state.sound_timer);
+	buf.put(state.keys);
+	for (uint64_t row : state.framebuf)
+		buf.put(row);
+	buf.put(state.rng);
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	bool ok = (fwrite(data, sizeof(data), 1, f) == 1);
+	ok &= (fclose(f) == 0);
+	return ok;
+}
+
+bool read_state_file(State& state, const char* filename){
+	uint8_t data[STATE_HEADER_SIZE + STATE_DATA_SIZE];
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	bool ok = (fread(data, sizeof(data), 1, f) == 1);
+	fclose(f);
+	if (!ok){
+		errno = EINVAL;
+		return false;
+	}
+
+	Buffer buf(data);
+	char magic[sizeof(STATE_MAGIC)];
+	buf.get_bytes(magic, sizeof(magic));
+	uint16_t version = buf.get<uint16_t>();
+	uint16_t size    = buf.get<uint16_t>();
+	if (memcmp(magic, STATE_MAGIC, sizeof(magic)) || version != STATE_VERSION ||
+	    size != STATE_DATA_SIZE){
+		errno = EINVAL;
+		return false;
+	}
+
+	buf.get_bytes(state.memory, sizeof(state.memory));
+	for (uint16_t& value : state.stack)
+		value = buf.get<uint16_t>();
+	buf.get_bytes(state.regs, sizeof(state.regs));
+	state.I           = buf.get<uint16_t>();
+	state.sp          = buf.get<uint8_t>();
+	state.pc          = buf.get<uint16_t>();
+	state.delay_timer = buf.get<uint8_t>();
+	state.sound_timer = buf.get<uint8_t>();
+	state.keys        = buf.get<uint16_t>();
+	for (uint64_t& row : state.framebuf)
+		row = buf.get<uint64_t>();
+	state.rng = buf.get<uint32_t>();
+
+	// Don't trust the file
+	if (state.sp >= 16 || state.pc >= sizeof(state.memory)-1){
+		errno = EINVAL;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,33 @@
+#ifndef _STATE_H
+#define _STATE_H
+
+#include <cstdint>
+#include "frontend.h"
+
+// Snapshot of the whole emulator state. It's a plain struct so it can be
+// copied around cheaply, see Emulator::save_state() and load_state().
+struct State {
+	uint8_t  memory[4096];
+	uint16_t stack[16];
+	uint8_t  regs[16];
+	uint16_t I;
+	uint8_t  sp;
+	uint16_t pc;
+	uint8_t  delay_timer;
+	uint8_t  sound_timer;
+	uint16_t keys;
+	uint64_t framebuf[FRAMEBUF_H];
+	uint32_t rng;
+};
+
+// Save state file format version. Increase it when the format changes
+const uint16_t STATE_VERSION = 2;
+
+// Write `state` to `filename`. Returns false on error, with errno set
+bool write_state_file(const State& state, const char* filename);
+
+// Read `state` from `filename`. Returns false on error, or if the file is
+// not a valid save state of the current version
+bool read_state_file(State& state, const char* filename);
+
+#endif
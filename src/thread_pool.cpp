@@ -0,0 +1,66 @@
+#include <thread>
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(uint threads)
+	: n_threads(threads ? threads : std::thread::hardware_concurrency())
+{
+	if (n_threads == 0)
+		n_threads = 1;
+	queues = std::vector<Queue>(n_threads);
+}
+
+uint ThreadPool::size() const {
+	return n_threads;
+}
+
+bool ThreadPool::take(uint thread, size_t& job){
+	// Own queue first
+	Queue& own = queues[thread];
+	{
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.jobs.empty()){
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+
+	// Steal from the other threads. Jobs are never added while running, so
+	// once every queue is empty we are done
+	for (uint i = 1; i < n_threads; i++){
+		Queue& victim = queues[(thread + i) % n_threads];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty()){
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(size_t jobs, const std::function<void(size_t, uint)>& job){
+	// Give each thread a contiguous range, in reverse order so it takes
+	// them in order from the back
+	for (uint t = 0; t < n_threads; t++){
+		size_t start = jobs*t/n_threads, end = jobs*(t+1)/n_threads;
+		std::lock_guard<std::mutex> guard(queues[t].lock);
+		queues[t].jobs.clear();
+		for (size_t i = end; i > start; i--)
+			queues[t].jobs.push_back(i-1);
+	}
+
+	auto worker = [&](uint thread){
+		size_t i;
+		while (take(thread, i))
+			job(i, thread);
+	};
+
+	// The calling thread is one of the workers
+	std::vector<std::thread> threads;
+	for (uint t = 1; t < n_threads; t++)
+		threads.emplace_back(worker, t);
+	worker(0);
+	for (std::thread& t : threads)
+		t.join();
+}
@@ -0,0 +1,42 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+
+// Runs independent jobs, identified by an index, on a fixed number of
+// threads. Jobs are split evenly among per-thread queues. Each thread takes
+// jobs from the back of its own queue, and when it's empty it steals from
+// the front of the others, so threads that get short jobs help with the
+// long ones.
+class ThreadPool {
+	public:
+		// Create a pool of `threads` threads. 0 means one per core
+		ThreadPool(uint threads = 0);
+
+		// Number of threads
+		uint size() const;
+
+		// Run `job(i, thread)` for every i in [0, `jobs`), where `thread` is
+		// the index of the thread running it. Returns when all of them have
+		// finished
+		void run(size_t jobs, const std::function<void(size_t, uint)>& job);
+
+	private:
+		struct Queue {
+			std::mutex         lock;
+			std::deque<size_t> jobs;
+		};
+
+		uint n_threads;
+		std::vector<Queue> queues;
+
+		// Take a job for `thread`. Returns false if there are no jobs left
+		bool take(uint thread, size_t& job);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <cstdint>
+#include <atomic>
+
+// Lock-free triple buffer to pass values of T from a writer thread to a
+// reader thread. The writer fills one buffer and publishes it, the reader
+// takes the newest published one, and the third buffer is exchanged between
+// them with an atomic swap. Neither side ever waits for the other: the
+// writer may publish many values before the reader takes one, and only the
+// newest is kept.
+template <class T>
+class TripleBuffer {
+	public:
+		TripleBuffer() : back(0), middle(1), front(2) {}
+
+		// Writer. Buffer where the next value is written. It's not
+		// initialized: it holds a value that was published before, if any
+		T& write_buffer(){
+			return buffers[back];
+		}
+
+		// Writer. Publish the value in write_buffer(). Returns whether the
+		// previous value was taken by the reader. If it wasn't, this value
+		// replaces it, and the reader will take this one instead
+		bool publish(){
+			uint8_t old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+			back = old & INDEX;
+			return !(old & FRESH);
+		}
+
+		// Reader. Take the newest published value into read_buffer(), if
+		// there's one that wasn't taken yet. Returns whether there was
+		bool update(){
+			if (!(middle.load(std::memory_order_relaxed) & FRESH))
+				return false;
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+			return true;
+		}
+
+		// Reader. Last value taken by update()
+		const T& read_buffer() const {
+			return buffers[front];
+		}
+
+	private:
+		// `middle` is the index of the buffer that is exchanged, with FRESH
+		// set if it was published and not taken yet
+		static const uint8_t INDEX = 3;
+		static const uint8_t FRESH = 4;
+
+		T buffers[3];
+
+		// Each index is on its own cache line, so the threads don't slow
+		// each other down
+		alignas(64) uint8_t              back;   // Only used by the writer
+		alignas(64) std::atomic<uint8_t> middle;
+		alignas(64) uint8_t              front;  // Only used by the reader
+};
+
+#endif
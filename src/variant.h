@@ -0,0 +1,61 @@
+#ifndef _VARIANT_H
+#define _VARIANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "inst.h"
+
+// Variants of CHIP-8 the emulator core can be specialized for, see
+// BasicEmulator. They are compile time parameters, so the core of each
+// variant only has the code and state it needs, and the classic CHIP-8 one
+// stays as it was.
+//
+// The display of the extended variants is always 128x64. In low resolution
+// mode each pixel is drawn as 2x2, so switching modes doesn't need a
+// different framebuffer.
+
+// Classic CHIP-8: 4KB of memory and a 64x32 display
+struct Chip8 {
+	static const bool     SCHIP       = false; // SUPER-CHIP instructions
+	static const bool     XO          = false; // XO-CHIP instructions
+	static const size_t   MEMORY_SIZE = 4096;
+	static const int      SCREEN_W    = 64;
+	static const int      SCREEN_H    = 32;
+	static const int      PLANES      = 1;
+
+	static Inst decode(uint16_t inst){
+		return decode_inst(inst);
+	}
+};
+
+// SUPER-CHIP 1.1: 128x64 high resolution mode, scrolling, 16x16 sprites, a
+// big font and the RPL flags
+struct SuperChip {
+	static const bool     SCHIP       = true;
+	static const bool     XO          = false;
+	static const size_t   MEMORY_SIZE = 4096;
+	static const int      SCREEN_W    = 128;
+	static const int      SCREEN_H    = 64;
+	static const int      PLANES      = 1;
+
+	static Inst decode(uint16_t inst){
+		return decode_inst(inst, EXT_SCHIP);
+	}
+};
+
+// XO-CHIP: SUPER-CHIP with 64KB of memory, two display planes, scrolling up
+// and saving and loading ranges of registers
+struct XoChip {
+	static const bool     SCHIP       = true;
+	static const bool     XO          = true;
+	static const size_t   MEMORY_SIZE = 65536;
+	static const int      SCREEN_W    = 128;
+	static const int      SCREEN_H    = 64;
+	static const int      PLANES      = 2;
+
+	static Inst decode(uint16_t inst){
+		return decode_inst(inst, EXT_SCHIP | EXT_XO);
+	}
+};
+
+#endif
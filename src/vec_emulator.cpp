@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <assert.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "vec_emulator.h"
+#include "emulator.h"
+#include "frontend_null.h"
+#include "rng.h"
+#include "sprite.h"
+
+VecEmulator::VecEmulator(const char* filename, size_t instances)
+	: n(instances)
+	, n_lanes((instances + LANES-1) / LANES * LANES)
+	, regs(16*n_lanes, 0)
+	, I(n_lanes, 0)
+	, pc(n_lanes, 0)
+	, sp(n_lanes, 0)
+	, delay_timer(n_lanes, 0)
+	, sound_timer(n_lanes, 0)
+	, keys(n_lanes, 0)
+	, rng(n_lanes, 0)
+	, seeds(n_lanes, 0)
+	, memory(n_lanes*MEM_SIZE, 0)
+	, stack(n_lanes*STACK_SIZE, 0)
+	, framebufs(n_lanes*FRAMEBUF_H, 0)
+	, running(n_lanes, 0)
+	, waiting(n_lanes, 0)
+	, active(n_lanes, 0)
+	, mask(n_lanes, 0)
+	, budget(n_lanes, 0)
+	, faults(n)
+	, n_instructions(0)
+{
+	// Get the power on state from an emulator
+	NullFrontend frontend;
+	Emulator emu(filename, frontend);
+	emu.save_state(initial);
+	for (size_t i = 0; i < MEM_SIZE-1; i++)
+		decoded[i] = decode_inst((initial.memory[i] << 8) | initial.memory[i+1]);
+	decoded[MEM_SIZE-1] = decode_inst(initial.memory[MEM_SIZE-1] << 8);
+	memset(written, 0, sizeof(written));
+
+	set_seed(time(NULL));
+	for (size_t i = 0; i < n; i++){
+		reset(i);
+		if (!emu.get_fault().empty()){
+			running[i] = 0;
+			faults[i]  = emu.get_fault();
+		}
+	}
+}
+
+size_t VecEmulator::size() const {
+	return n;
+}
+
+void VecEmulator::set_seed(uint32_t seed){
+	for (size_t i = 0; i < n; i++){
+		seeds[i] = seed + i;
+		rng[i]   = rng_init(seeds[i]);
+	}
+}
+
+void VecEmulator::reset(size_t i){
+	assert(i < n);
+	load_state(i, initial);
+	rng[i]     = rng_init(seeds[i]);
+	running[i] = 0xFF;
+	faults[i].clear();
+}
+
+const uint64_t* VecEmulator::get_framebufs() const {
+	return framebufs.data();
+}
+
+bool VecEmulator::is_running(size_t i) const {
+	return running[i];
+}
+
+const std::string& VecEmulator::get_fault(size_t i) const {
+	return faults[i];
+}
+
+uint64_t VecEmulator::instructions() const {
+	return n_instructions;
+}
+
+void VecEmulator::save_state(size_t i, State& state) const {
+	memset(&state, 0, sizeof(state)); // Padding too, as Emulator does
+	memcpy(state.memory, &memory[i*MEM_SIZE], MEM_SIZE);
+	memcpy(state.stack, &stack[i*STACK_SIZE], sizeof(state.stack));
+	for (int x = 0; x < 16; x++)
+		state.regs[x] = regs[x*n_lanes + i];
+	state.I           = I[i];
+	state.sp          = sp[i];
+	state.pc          = pc[i];
+	state.delay_timer = delay_timer[i];
+	state.sound_timer = sound_timer[i];
+	state.keys        = keys[i];
+	memcpy(state.framebuf, &framebufs[i*FRAMEBUF_H], sizeof(state.framebuf));
+	state.rng         = rng[i];
+}
+
+void VecEmulator::load_state(size_t i, const State& state){
+	assert(i < n);
+	memcpy(&memory[i*MEM_SIZE], state.memory, MEM_SIZE);
+	memcpy(&stack[i*STACK_SIZE], state.stack, sizeof(state.stack));
+	for (int x = 0; x < 16; x++)
+		regs[x*n_lanes + i] = state.regs[x];
+	I[i]           = state.I;
+	sp[i]          = state.sp;
+	pc[i]          = state.pc;
+	delay_timer[i] = state.delay_timer;
+	sound_timer[i] = state.sound_timer;
+	keys[i]        = state.keys;
+	memcpy(&framebufs[i*FRAMEBUF_H], state.framebuf, sizeof(state.framebuf));
+	rng[i]         = state.rng;
+
+	// Instructions that differ from the ROM must be decoded for each lane
+	for (size_t addr = 0; addr < MEM_SIZE; addr++)
+		if (state.memory[addr] != initial.memory[addr])
+			written[addr] = true;
+}
+
+void VecEmulator::raise_fault(size_t i, const char* fmt, ...){
+	char msg[128];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	char where[32];
+	snprintf(where, sizeof(where), " at 0x%X", pc[i]);
+	faults[i]  = std::string(msg) + where;
+	running[i] = 0;
+	active[i]  = 0;
+}
+
+uint16_t VecEmulator::lowest_pc(){
+#ifdef __AVX2__
+	// Inactive lanes are ORed with 0xFFFF
+	__m256i best = _mm256_set1_epi16(-1);
+	for (size_t i = 0; i < n_lanes; i += 16){
+		__m256i act = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&active[i]));
+		__m256i p   = _mm256_loadu_si256((const __m256i*)&pc[i]);
+		p    = _mm256_or_si256(p, _mm256_xor_si256(act, _mm256_set1_epi16(-1)));
+		best = _mm256_min_epu16(best, p);
+	}
+	__m128i best128 = _mm_min_epu16(_mm256_castsi256_si128(best),
+	                                _mm256_extracti128_si256(best, 1));
+	return _mm_extract_epi16(_mm_minpos_epu16(best128), 0);
+#else
+	uint16_t best = 0xFFFF;
+	for (size_t i = 0; i < n_lanes; i++)
+		if (active[i] && pc[i] < best)
+			best = pc[i];
+	return best;
+#endif
+}
+
+size_t VecEmulator::select_lanes(uint16_t addr){
+	size_t count = 0;
+#ifdef __AVX2__
+	const __m256i addr_v = _mm256_set1_epi16(addr);
+	for (size_t i = 0; i < n_lanes; i += 32){
+		__m256i lo = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)&pc[i]), addr_v);
+		__m256i hi = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)&pc[i+16]), addr_v);
+
+		// Packing works on each 128-bit half, so fix the order after it
+		__m256i eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+		__m256i m  = _mm256_and_si256(eq, _mm256_loadu_si256((const __m256i*)&active[i]));
+		_mm256_storeu_si256((__m256i*)&mask[i], m);
+		count += __builtin_popcount(_mm256_movemask_epi8(m));
+	}
+#else
+	for (size_t i = 0; i < n_lanes; i++){
+		mask[i] = (active[i] && pc[i] == addr ? 0xFF : 0);
+		count  += (mask[i] != 0);
+	}
+#endif
+	return count;
+}
+
+void VecEmulator::consume_budget(){
+#ifdef __AVX2__
+	for (size_t i = 0; i < n_lanes; i += 16){
+		// Masked lanes are -1
+		__m128i m = _mm_loadu_si128((const __m128i*)&mask[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i*)&budget[i]);
+		b = _mm256_add_epi16(b, _mm256_cvtepi8_epi16(m));
+		_mm256_storeu_si256((__m256i*)&budget[i], b);
+
+		__m256i zero = _mm256_cmpeq_epi16(b, _mm256_setzero_si256());
+		__m128i done = _mm_packs_epi16(_mm256_castsi256_si128(zero),
+		                               _mm256_extracti128_si256(zero, 1));
+		__m128i act  = _mm_loadu_si128((const __m128i*)&active[i]);
+		_mm_storeu_si128((__m128i*)&active[i], _mm_andnot_si128(done, act));
+	}
+#else
+	for (size_t i = 0; i < n_lanes; i++){
+		if (mask[i] && --budget[i] == 0)
+			active[i] = 0;
+	}
+#endif
+}
+
+void VecEmulator::run_lane(size_t i, const Inst& inst){
+	// Same as instructions.inc, for lane `i`
+	auto R = [&](int x) -> uint8_t& { return regs[x*n_lanes + i]; };
+	uint8_t*  mem      = &memory[i*MEM_SIZE];
+	uint16_t* stk      = &stack[i*STACK_SIZE];
+	uint64_t* framebuf = &framebufs[i*FRAMEBUF_H];
+	uint16_t& pc       = this->pc[i];
+	uint16_t& I        = this->I[i];
+	uint8_t&  sp       = this->sp[i];
+
+	switch (inst.op){
+		case OP_CLS:
+			memset(framebuf, 0, FRAMEBUF_H*sizeof(uint64_t));
+			pc += 2;
+			break;
+
+		case OP_RET:
+			if (sp == 0){
+				raise_fault(i, "stack underflow");
+				break;
+			}
+			pc = stk[sp--] + 2;
+			break;
+
+		case OP_JP:
+			pc = inst.nnn;
+			break;
+
+		case OP_CALL:
+			if (sp == STACK_SIZE-1){
+				raise_fault(i, "stack overflow");
+				break;
+			}
+			stk[++sp] = pc;
+			pc = inst.nnn;
+			break;
+
+		case OP_SE_BYTE:  pc += (R(inst.x) == inst.kk ? 4 : 2); break;
+		case OP_SNE_BYTE: pc += (R(inst.x) != inst.kk ? 4 : 2); break;
+		case OP_SE_REG:   pc += (R(inst.x) == R(inst.y) ? 4 : 2); break;
+		case OP_SNE_REG:  pc += (R(inst.x) != R(inst.y) ? 4 : 2); break;
+		case OP_LD_BYTE:  R(inst.x) = inst.kk; pc += 2; break;
+		case OP_ADD_BYTE: R(inst.x) += inst.kk; pc += 2; break;
+		case OP_LD_REG:   R(inst.x) = R(inst.y); pc += 2; break;
+		case OP_OR:       R(inst.x) |= R(inst.y); pc += 2; break;
+		case OP_AND:      R(inst.x) &= R(inst.y); pc += 2; break;
+		case OP_XOR:      R(inst.x) ^= R(inst.y); pc += 2; break;
+
+		case OP_ADD_REG:
+			R(0xF) = ((uint16_t)R(inst.x) + R(inst.y) > 255);
+			R(inst.x) += R(inst.y);
+			pc += 2;
+			break;
+
+		case OP_SUB:
+			R(0xF) = (R(inst.x) >= R(inst.y));
+			R(inst.x) -= R(inst.y);
+			pc += 2;
+			break;
+
+		case OP_SHR:
+			R(0xF) = R(inst.x) & 1;
+			R(inst.x) >>= 1;
+			pc += 2;
+			break;
+
+		case OP_SUBN:
+			R(0xF) = (R(inst.y) >= R(inst.x));
+			R(inst.x) = R(inst.y) - R(inst.x);
+			pc += 2;
+			break;
+
+		case OP_SHL:
+			R(0xF) = R(inst.x) >> 7;
+			R(inst.x) <<= 1;
+			pc += 2;
+			break;
+
+		case OP_LD_I:
+			I = inst.nnn;
+			pc += 2;
+			break;
+
+		case OP_JP_V0:
+			pc = R(0) + inst.nnn;
+			break;
+
+		case OP_RND:
+			R(inst.x) = rng_next(rng[i]) & inst.kk;
+			pc += 2;
+			break;
+
+		case OP_DRW:
+			if (I > MEM_SIZE - inst.kk){
+				raise_fault(i, "sprite out of memory (I = 0x%X)", I);
+				break;
+			}
+			R(0xF) = draw_sprite(framebuf, &mem[I], inst.kk, R(inst.x), R(inst.y));
+			pc += 2;
+			break;
+
+		case OP_SKP:
+			pc += (R(inst.x) < 16 && (keys[i] >> R(inst.x)) & 1 ? 4 : 2);
+			break;
+
+		case OP_SKNP:
+			pc += (R(inst.x) < 16 && (keys[i] >> R(inst.x)) & 1 ? 2 : 4);
+			break;
+
+		case OP_LD_VX_DT: R(inst.x) = delay_timer[i]; pc += 2; break;
+		case OP_LD_DT_VX: delay_timer[i] = R(inst.x); pc += 2; break;
+		case OP_LD_ST_VX: sound_timer[i] = R(inst.x); pc += 2; break;
+
+		case OP_LD_VX_K:
+			// Halt until the next frame if no key is pressed
+			if (keys[i] == 0){
+				waiting[i] = 0xFF;
+				active[i]  = 0;
+			} else {
+				R(inst.x) = __builtin_ctz(keys[i]);
+				pc += 2;
+			}
+			break;
+
+		case OP_ADD_I:
+			R(0xF) = ((uint16_t)I + R(inst.x) > 255);
+			I += R(inst.x);
+			pc += 2;
+			break;
+
+		case OP_LD_F:
+			if (R(inst.x) > 0xF){
+				raise_fault(i, "invalid digit 0x%X", R(inst.x));
+				break;
+			}
+			I = R(inst.x)*5;
+			pc += 2;
+			break;
+
+		case OP_LD_B:
+			if (I > MEM_SIZE-3){
+				raise_fault(i, "write out of memory (I = 0x%X)", I);
+				break;
+			}
+			mem[I]   = R(inst.x) / 100;
+			mem[I+1] = (R(inst.x) / 10) % 10;
+			mem[I+2] = R(inst.x) % 10;
+			memset(&written[I], true, 3);
+			pc += 2;
+			break;
+
+		case OP_LD_MEM_VX:
+			if (I > MEM_SIZE-(inst.x+1)){
+				raise_fault(i, "write out of memory (I = 0x%X)", I);
+				break;
+			}
+			for (int x = 0; x <= inst.x; x++)
+				mem[I+x] = R(x);
+			memset(&written[I], true, inst.x+1);
+			pc += 2;
+			break;
+
+		case OP_LD_VX_MEM:
+			if (I > MEM_SIZE-(inst.x+1)){
+				raise_fault(i, "read out of memory (I = 0x%X)", I);
+				break;
+			}
+			for (int x = 0; x <= inst.x; x++)
+				R(x) = mem[I+x];
+			pc += 2;
+			break;
+
+		default:
+			raise_fault(i, "unknown instruction 0x%04X", inst.nnn);
+	}
+}
+
+bool VecEmulator::run_vector(const Inst& inst){
+#ifdef __AVX2__
+	switch (inst.op){
+		case OP_LD_BYTE: case OP_ADD_BYTE: case OP_LD_REG: case OP_OR:
+		case OP_AND: case OP_XOR: case OP_ADD_REG: case OP_SUB: case OP_SHR:
+		case OP_SUBN: case OP_SHL: case OP_LD_VX_DT: case OP_LD_DT_VX:
+		case OP_LD_ST_VX: case OP_SE_BYTE: case OP_SNE_BYTE: case OP_SE_REG:
+		case OP_SNE_REG: case OP_JP: case OP_LD_I: case OP_ADD_I:
+			break;
+		default:
+			return false;
+	}
+
+	uint8_t* vx = V(inst.x);
+	uint8_t* vy = V(inst.y);
+	uint8_t* vf = V(0xF);
+	const __m256i one = _mm256_set1_epi8(1);
+
+	// Byte sized state, 32 lanes at a time. The flag is written before the
+	// result, and registers are loaded again after it, in case x or y is F
+	bool byte_state = !(inst.op == OP_SE_BYTE || inst.op == OP_SNE_BYTE ||
+	                    inst.op == OP_SE_REG || inst.op == OP_SNE_REG ||
+	                    inst.op == OP_JP || inst.op == OP_LD_I ||
+	                    inst.op == OP_ADD_I);
+	for (size_t i = 0; byte_state && i < n_lanes; i += 32){
+		__m256i m = _mm256_loadu_si256((const __m256i*)&mask[i]);
+		if (_mm256_testz_si256(m, m))
+			continue;
+		auto load = [&](const uint8_t* p){
+			return _mm256_loadu_si256((const __m256i*)&p[i]);
+		};
+		auto store = [&](uint8_t* p, __m256i value){
+			_mm256_storeu_si256((__m256i*)&p[i],
+			                    _mm256_blendv_epi8(load(p), value, m));
+		};
+
+		__m256i a = load(vx), b = load(vy);
+		switch (inst.op){
+			case OP_LD_BYTE: store(vx, _mm256_set1_epi8(inst.kk)); break;
+			case OP_ADD_BYTE: store(vx, _mm256_add_epi8(a, _mm256_set1_epi8(inst.kk))); break;
+			case OP_LD_REG: store(vx, b); break;
+			case OP_OR:  store(vx, _mm256_or_si256(a, b)); break;
+			case OP_AND: store(vx, _mm256_and_si256(a, b)); break;
+			case OP_XOR: store(vx, _mm256_xor_si256(a, b)); break;
+
+			case OP_ADD_REG: {
+				// Carry if the saturated sum differs from the wrapped one
+				__m256i eq = _mm256_cmpeq_epi8(_mm256_adds_epu8(a, b),
+				                               _mm256_add_epi8(a, b));
+				store(vf, _mm256_andnot_si256(eq, one));
+				store(vx, _mm256_add_epi8(load(vx), load(vy)));
+				break;
+			}
+
+			case OP_SUB:
+				store(vf, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a), one));
+				store(vx, _mm256_sub_epi8(load(vx), load(vy)));
+				break;
+
+			case OP_SUBN:
+				store(vf, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b), one));
+				store(vx, _mm256_sub_epi8(load(vy), load(vx)));
+				break;
+
+			case OP_SHR:
+				store(vf, _mm256_and_si256(a, one));
+				a = load(vx);
+				store(vx, _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)));
+				break;
+
+			case OP_SHL:
+				store(vf, _mm256_and_si256(_mm256_srli_epi16(a, 7), one));
+				a = load(vx);
+				store(vx, _mm256_add_epi8(a, a));
+				break;
+
+			case OP_LD_VX_DT: store(vx, load(delay_timer.data())); break;
+			case OP_LD_DT_VX: store(delay_timer.data(), a); break;
+			case OP_LD_ST_VX: store(sound_timer.data(), a); break;
+			default: break;
+		}
+	}
+
+	// Word sized state, 16 lanes at a time
+	for (size_t i = 0; i < n_lanes; i += 16){
+		__m128i m8 = _mm_loadu_si128((const __m128i*)&mask[i]);
+		if (_mm_testz_si128(m8, m8))
+			continue;
+		__m256i m = _mm256_cvtepi8_epi16(m8);
+		auto load = [&](const uint16_t* p){
+			return _mm256_loadu_si256((const __m256i*)&p[i]);
+		};
+		auto store = [&](uint16_t* p, __m256i value){
+			_mm256_storeu_si256((__m256i*)&p[i],
+			                    _mm256_blendv_epi8(load(p), value, m));
+		};
+		auto load_reg = [&](const uint8_t* p){
+			return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&p[i]));
+		};
+
+		// Instructions after a skip are 4 bytes away instead of 2
+		const __m256i two = _mm256_set1_epi16(2);
+		__m256i p = load(pc.data());
+		__m256i skip;
+		switch (inst.op){
+			case OP_JP:
+				store(pc.data(), _mm256_set1_epi16(inst.nnn));
+				continue;
+
+			case OP_SE_BYTE:
+			case OP_SNE_BYTE:
+			case OP_SE_REG:
+			case OP_SNE_REG:
+				skip = _mm256_cmpeq_epi16(load_reg(vx),
+				                          (inst.op == OP_SE_BYTE || inst.op == OP_SNE_BYTE
+				                           ? _mm256_set1_epi16(inst.kk)
+				                           : load_reg(vy)));
+				if (inst.op == OP_SNE_BYTE || inst.op == OP_SNE_REG)
+					skip = _mm256_xor_si256(skip, _mm256_set1_epi16(-1));
+				p = _mm256_add_epi16(p, _mm256_and_si256(skip, two));
+				break;
+
+			case OP_LD_I:
+				store(I.data(), _mm256_set1_epi16(inst.nnn));
+				break;
+
+			case OP_ADD_I: {
+				// Flag if I + Vx > 255, that is, I >= 256 - Vx
+				__m256i iv   = load(I.data());
+				__m256i flag = _mm256_cmpeq_epi16(
+					_mm256_max_epu16(iv, _mm256_sub_epi16(_mm256_set1_epi16(256), load_reg(vx))),
+					iv);
+				__m128i flag8 = _mm_packs_epi16(_mm256_castsi256_si128(flag),
+				                                _mm256_extracti128_si256(flag, 1));
+				flag8 = _mm_and_si128(flag8, _mm_set1_epi8(1));
+				__m128i old = _mm_loadu_si128((const __m128i*)&vf[i]);
+				_mm_storeu_si128((__m128i*)&vf[i], _mm_blendv_epi8(old, flag8, m8));
+				store(I.data(), _mm256_add_epi16(iv, load_reg(vx)));
+				break;
+			}
+
+			default:
+				break;
+		}
+		store(pc.data(), _mm256_add_epi16(p, two));
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void VecEmulator::run_detached(size_t i){
+	while (active[i]){
+		uint16_t addr = pc[i];
+		if (addr >= MEM_SIZE-1)
+			raise_fault(i, "pc out of memory");
+		else if (!written[addr] && !written[addr+1])
+			run_lane(i, decoded[addr]);
+		else {
+			const uint8_t* mem = &memory[i*MEM_SIZE];
+			run_lane(i, decode_inst((mem[addr] << 8) | mem[addr+1]));
+		}
+		n_instructions++;
+		if (--budget[i] == 0)
+			active[i] = 0;
+	}
+}
+
+void VecEmulator::run_slice(uint inst){
+	assert(inst > 0 && inst <= 0xFFFF);
+	for (size_t i = 0; i < n_lanes; i++){
+		active[i] = running[i] & ~waiting[i];
+		budget[i] = inst;
+	}
+
+	uint16_t addr;
+	while ((addr = lowest_pc()) != 0xFFFF){
+		size_t count = select_lanes(addr);
+		if (count <= DETACH_LANES){
+			// Scanning all lanes to run an instruction in so few of them
+			// costs more than running them on their own
+			for (size_t i = 0; i < n_lanes; i++)
+				if (mask[i])
+					run_detached(i);
+			continue;
+		}
+
+		n_instructions += count;
+		if (addr >= MEM_SIZE-1){
+			for (size_t i = 0; i < n_lanes; i++)
+				if (mask[i])
+					raise_fault(i, "pc out of memory");
+		} else if (!written[addr] && !written[addr+1]){
+			// Every lane has the same instruction
+			const Inst& inst = decoded[addr];
+			if (!run_vector(inst)){
+				for (size_t i = 0; i < n_lanes; i++)
+					if (mask[i])
+						run_lane(i, inst);
+			}
+		} else {
+			// Lanes may have written different instructions here
+			for (size_t i = 0; i < n_lanes; i++){
+				if (!mask[i])
+					continue;
+				const uint8_t* mem = &memory[i*MEM_SIZE];
+				run_lane(i, decode_inst((mem[addr] << 8) | mem[addr+1]));
+			}
+		}
+		consume_budget();
+	}
+}
+
+const uint64_t* VecEmulator::step(const uint16_t* actions, uint inst_per_frame){
+	for (size_t i = 0; i < n; i++){
+		keys[i]    = actions[i];
+		waiting[i] = 0;
+	}
+
+	// Budgets are 16 bits, so long frames are run in slices
+	while (inst_per_frame > 0){
+		uint inst = (inst_per_frame > 0xFFFF ? 0xFFFF : inst_per_frame);
+		run_slice(inst);
+		inst_per_frame -= inst;
+	}
+
+	// Update timers
+	for (size_t i = 0; i < n_lanes; i++){
+		if (delay_timer[i] > 0) delay_timer[i]--;
+		if (sound_timer[i] > 0) sound_timer[i]--;
+	}
+	return framebufs.data();
+}
@@ -0,0 +1,157 @@
+#ifndef _VEC_EMULATOR_H
+#define _VEC_EMULATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "frontend.h"
+#include "inst.h"
+#include "state.h"
+
+// Runs many instances of the same ROM in lockstep, for search and training
+// workloads. The state is stored as a structure of arrays: register Vx of
+// every instance is contiguous, and so are I, pc, sp and the timers. Each
+// instance only has its own memory, stack and framebuffer.
+//
+// Execution is SIMT-like: each iteration, the lowest pc among the instances
+// that haven't finished the frame is chosen, and the instruction there is
+// run by every instance at that pc, while the others are masked out. When
+// instances take different paths, they converge again at the lowest pc.
+// Common instructions (arithmetic, skips, jumps, timers and I) are run with
+// AVX2 across 32 instances at once. The rest are run one instance at a time.
+//
+// It behaves exactly like Emulator with the same seed and keys, but it has
+// no frontend: keys are given to step(), and the framebuffers are read
+// directly from the returned buffer.
+class VecEmulator {
+	public:
+		// Create `instances` instances of the ROM `filename`. If it can't be
+		// loaded, all of them are stopped with a fault
+		VecEmulator(const char* filename, size_t instances);
+
+		// Number of instances
+		size_t size() const;
+
+		// Seed the random number generators. Instance i is seeded with
+		// `seed` + i
+		void set_seed(uint32_t seed);
+
+		// Put instance `i` back to its power on state, keeping its seed
+		void reset(size_t i);
+
+		// Run a frame in every instance that is running. `actions` has the
+		// keys pressed in each instance, bit i set means key i is pressed.
+		// Returns the framebuffers, see get_framebufs()
+		const uint64_t* step(const uint16_t* actions,
+		                     uint inst_per_frame = DEFAULT_INST_PER_FRAME);
+
+		// Framebuffers of all instances in one contiguous buffer: rows of
+		// instance i are at [i*FRAMEBUF_H, (i+1)*FRAMEBUF_H). It's updated in
+		// place by step()
+		const uint64_t* get_framebufs() const;
+
+		// Is instance `i` running? It stops when there's a fault
+		bool is_running(size_t i) const;
+
+		// Error that stopped instance `i`, empty if there's none
+		const std::string& get_fault(size_t i) const;
+
+		// Instructions run by all instances
+		uint64_t instructions() const;
+
+		// Copy the state of instance `i` into `state`, or restore it
+		void save_state(size_t i, State& state) const;
+		void load_state(size_t i, const State& state);
+
+		static const uint DEFAULT_INST_PER_FRAME = 10;
+
+	private:
+		// Instances are processed in groups of this size. The arrays are
+		// padded to a multiple of it with lanes that never run
+		static const size_t LANES = 32;
+		static const size_t MEM_SIZE = sizeof(State::memory);
+		static const size_t STACK_SIZE = sizeof(State::stack)/sizeof(State::stack[0]);
+
+		// Lanes that are alone at their pc, or with this many others at
+		// most, leave lockstep and run on their own until the end of the
+		// frame
+		static const size_t DETACH_LANES = 8;
+
+		size_t n;       // Number of instances
+		size_t n_lanes; // Number of lanes, including padding
+
+		// Power on state and decoded instructions of the ROM
+		State initial;
+		Inst  decoded[MEM_SIZE];
+
+		// Addresses written by any instance. Instructions there may differ
+		// between instances, so they are decoded for each one
+		bool written[MEM_SIZE];
+
+		// Registers: V0 of every lane, then V1...
+		std::vector<uint8_t>  regs;
+		std::vector<uint16_t> I;
+		std::vector<uint16_t> pc;
+		std::vector<uint8_t>  sp;
+		std::vector<uint8_t>  delay_timer;
+		std::vector<uint8_t>  sound_timer;
+		std::vector<uint16_t> keys;
+		std::vector<uint32_t> rng;
+		std::vector<uint32_t> seeds;
+
+		// Memory, stack and framebuffer of each lane, one after the other
+		std::vector<uint8_t>  memory;
+		std::vector<uint16_t> stack;
+		std::vector<uint64_t> framebufs;
+
+		// 0xFF for lanes that are running, 0 for the rest
+		std::vector<uint8_t> running;
+
+		// 0xFF for lanes halted by Fx0A until the next frame
+		std::vector<uint8_t> waiting;
+
+		// 0xFF for lanes that may run more instructions in this frame
+		std::vector<uint8_t> active;
+
+		// 0xFF for lanes that run the current instruction
+		std::vector<uint8_t> mask;
+
+		// Instructions left in this frame for each lane
+		std::vector<uint16_t> budget;
+
+		std::vector<std::string> faults;
+		uint64_t n_instructions;
+
+		uint8_t* V(int x) { return &regs[x*n_lanes]; }
+
+		// Stop lane `i` with a fault
+		void raise_fault(size_t i, const char* fmt, ...)
+			__attribute__((format(printf, 3, 4)));
+
+		// Lowest pc of the active lanes, or 0xFFFF if there are none
+		uint16_t lowest_pc();
+
+		// Set `mask` for the active lanes with pc `addr`. Returns how many
+		// there are
+		size_t select_lanes(uint16_t addr);
+
+		// Run `inst` in lane `i`
+		void run_lane(size_t i, const Inst& inst);
+
+		// Run `inst` in the lanes in `mask` with AVX2. Returns false if it's
+		// not one of the instructions that can be run this way
+		bool run_vector(const Inst& inst);
+
+		// Run lane `i` on its own until the end of the slice
+		void run_detached(size_t i);
+
+		// Subtract one instruction from the budget of the lanes in `mask`,
+		// and deactivate the ones that have finished the frame
+		void consume_budget();
+
+		// Run a frame of at most 65535 instructions
+		void run_slice(uint inst);
+};
+
+#endif
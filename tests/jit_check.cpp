@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "emulator.h"
+#include "frontend_null.h"
+#include "jit.h"
+
+// Runs ROMs with the switch interpreter and the JIT side by side, with the
+// same input, and checks that they agree after every frame. tests/roms has
+// ROMs written to stress the JIT, such as LOADRUN, a long run of FF65 entered
+// at every offset, which fills the code cache with the largest blocks.
+
+const uint FRAMES = 600;
+
+// Instructions per frame to run each ROM with. Few of them make translated
+// code exit often, many of them make it run long chains of blocks
+const uint INST_PER_FRAME[] = { Emulator::DEFAULT_INST_PER_FRAME, 1000 };
+
+// Keys pressed at `frame`, as chip-8-bench does
+uint16_t check_keys(uint64_t frame){
+	if (frame % 12 >= 6)
+		return 0;
+	return 1 << ((frame / 12) * 7 % 16);
+}
+
+// Add `path` to `roms`, or the files in it if it's a directory
+void add_roms(const char* path, std::vector<std::string>& roms){
+	struct stat st;
+	if (stat(path, &st) == -1){
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if (!S_ISDIR(st.st_mode)){
+		roms.push_back(path);
+		return;
+	}
+	DIR* d = opendir(path);
+	if (!d){
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	std::vector<std::string> files;
+	while (struct dirent* entry = readdir(d)){
+		if (entry->d_name[0] != '.')
+			files.push_back(std::string(path) + "/" + entry->d_name);
+	}
+	closedir(d);
+	std::sort(files.begin(), files.end());
+	roms.insert(roms.end(), files.begin(), files.end());
+}
+
+// Run `rom` on both backends. Returns false and prints where they diverge
+// if they don't agree
+bool check_rom(const char* rom, uint inst_per_frame){
+	NullFrontend frontends[2];
+	Emulator ref(rom, frontends[0]);
+	Emulator jit(rom, frontends[1]);
+	ref.set_backend(Emulator::BACKEND_SWITCH);
+	jit.set_backend(Emulator::BACKEND_JIT);
+	ref.set_seed(0);
+	jit.set_seed(0);
+
+	for (uint frame = 0; frame < FRAMES && ref.is_running(); frame++){
+		frontends[0].set_keys(check_keys(frame));
+		frontends[1].set_keys(check_keys(frame));
+		ref.run_frame(inst_per_frame);
+		jit.run_frame(inst_per_frame);
+
+		// save_state() clears the padding, so states can be compared whole
+		State ref_state, jit_state;
+		ref.save_state(ref_state);
+		jit.save_state(jit_state);
+		if (memcmp(&ref_state, &jit_state, sizeof(State)) ||
+		    ref.get_stats().instructions != jit.get_stats().instructions ||
+		    ref.get_fault() != jit.get_fault() ||
+		    ref.is_running() != jit.is_running()){
+			printf("%s: %u instructions per frame: diverged at frame %u "
+			       "(pc %03X / %03X, %lu / %lu instructions)\n",
+			       rom, inst_per_frame, frame, ref_state.pc, jit_state.pc,
+			       ref.get_stats().instructions, jit.get_stats().instructions);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv){
+	if (argc < 2){
+		fprintf(stderr, "Usage: %s rom-dir | romfile...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!Jit::supported()){
+		printf("JIT not supported in this host, nothing to check\n");
+		return EXIT_SUCCESS;
+	}
+
+	std::vector<std::string> roms;
+	for (int i = 1; i < argc; i++)
+		add_roms(argv[i], roms);
+
+	int failed = 0;
+	for (const std::string& rom : roms){
+		for (uint inst_per_frame : INST_PER_FRAME){
+			if (!check_rom(rom.c_str(), inst_per_frame))
+				failed++;
+		}
+	}
+	printf("%zu ROMs checked, %d failed\n", roms.size(), failed);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}